@@ -7,7 +7,9 @@
 
 #include "SimpleCam.h"
 
+#include <algorithm>
 #include <chrono>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <memory>
@@ -15,6 +17,7 @@
 #include <libcamera/libcamera.h>
 #include <opencv2/opencv.hpp>
 
+#include "image_view.h"
 #include "mapped_framebuffer.h"
 
 #include "event_loop.h"
@@ -40,63 +43,399 @@ using namespace libcamera;
 
 void SimpleCam::requestComplete(Request *request)
 {
-    // if (request->status() == Request::RequestCancelled)
-    // {
-    //     return;
-    // }
+    const FrameBuffer *buffer = request->findBuffer(stream);
+    bool deliver = buffer && request->status() != Request::RequestCancelled;
 
-    std::cout << "Completed " << (void *)request << std::endl;
-    // loop.callLater(std::bind(&processRequest, request));
-    //     // processRequest(request);
-    // }
+    /*
+     * Count the frame as held before the Request stops counting as in
+     * flight, so that waitIdle() can't find both at zero while the frame is
+     * on its way to processRequest().
+     */
+    if (deliver)
+        framesHeld.fetch_add(1, std::memory_order_relaxed);
 
-    // void SimpleCam::processRequest(Request *request)
-    // {
-    const Request::BufferMap &buffers = request->buffers();
-    // std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    unsigned int remaining = inFlight.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    if (remaining == 0)
+    {
+        std::unique_lock<std::mutex> locker(idleLock);
+        idleCond.notify_all();
+    }
 
-    for (auto bufferPair : buffers)
+    if (buffer)
+        stats.completed(buffer->metadata(), remaining);
+
+    if (request->status() == Request::RequestCancelled)
+        return;
+
+    /* Nothing to deliver, hand the Request straight back. */
+    if (!buffer)
     {
-        const Stream *stream = bufferPair.first;
-        FrameBuffer *buffer = bufferPair.second;
-        const FrameMetadata &metadata = buffer->metadata();
+        releaseRequest(request);
+        return;
+    }
 
-        /* Print some information about the buffer which has completed. */
-        std::cout << " seq: " << std::setw(6) << std::setfill('0') << metadata.sequence << " bytesused: ";
+    /*
+     * Nothing left queued in the camera while streaming means every Request
+     * is held by a consumer: the sensor is producing frames nobody can take.
+     */
+    if (remaining == 0 && streaming.load(std::memory_order_acquire))
+        starved.fetch_add(1, std::memory_order_relaxed);
 
-        unsigned int nplane = 0;
-        for (const FrameMetadata::Plane &plane : metadata.planes())
-        {
-            std::cout << plane.bytesused;
-            if (++nplane < metadata.planes().size())
-                std::cout << "/";
-        }
+    FrameSlot *slot = slots[request->cookie()].get();
+    slot->begin();
+    deadlines.watch(request->cookie(), slot, buffer->metadata());
 
-        // std::cout << std::endl;
+    loop.callLater([this, request]() { processRequest(request); }, EventLoop::Priority::Bulk);
+}
 
-        /*
-         * Image data can be accessed here, but the FrameBuffer
-         * must be mapped by the application
-         */
+/*
+ * Runs in the application's thread, which spins the EventLoop from start()
+ * to finish().
+ */
+
+void SimpleCam::processRequest(Request *request)
+{
+    std::cout << "Completed " << (void *)request << " in flight " << requestsInFlight() << std::endl;
+
+    FrameBuffer *buffer = request->findBuffer(stream);
+    deliverFrame(Frame(slots[request->cookie()].get(), buffer->metadata()));
+}
+
+void SimpleCam::deliverFrame(Frame frame)
+{
+    /* Overran its hard deadline before it got here. */
+    if (frame.cancelled())
+    {
+        stats.dropped(FrameStats::Drop::SlowConsumer);
+        return;
+    }
+
+    const FrameMetadata &metadata = frame.metadata();
+    const ImageView &view = frame.view();
+
+    /* Print some information about the buffer which has completed. */
+    std::cout << " seq: " << std::setw(6) << std::setfill('0') << metadata.sequence << " bytesused: ";
 
-        auto cfg = stream->configuration();
-        unsigned int width = cfg.size.width;
-        unsigned int height = cfg.size.height;
-        unsigned int stride = cfg.stride;
+    unsigned int nplane = 0;
+    for (const FrameMetadata::Plane &plane : metadata.planes())
+    {
+        std::cout << plane.bytesused;
+        if (++nplane < metadata.planes().size())
+            std::cout << "/";
+    }
+
+    if (!view.isValid())
+    {
+        std::cout << std::endl;
+        return;
+    }
+
+    const cv::Mat &image = view.plane(0);
+    std::cout << " size " << image.cols << "x" << image.rows << " stride " << image.step[0] << " format " << view.format().toString() << " sec "
+              << (double)clock() / CLOCKS_PER_SEC << std::endl;
+
+    if (publisher && streaming.load(std::memory_order_acquire))
+        publisher->publish(frame);
+
+    frame.setStage(FrameStage::Processing);
+    if (onFrame)
+        onFrame(frame);
+#ifdef SIMPLE_CAM_COROUTINES
+    frames.publish(frame);
+#endif
+    frame.setStage(FrameStage::Held);
+
+    /* Nothing is kept for the pull API once finish() has started. */
+    if (keepLatest && streaming.load(std::memory_order_acquire))
+        publishLatest(std::move(frame));
+}
+
+/*
+ * Build the slots handing out Frames for a set of buffers. The mappings must
+ * be in place, as each slot keeps a view of its buffer.
+ */
+int SimpleCam::createSlots(const StreamConfiguration &cfg, const std::vector<FrameBuffer *> &buffers, FrameSlot::Recycler recycler)
+{
+    for (unsigned int i = 0; i < buffers.size(); ++i)
+    {
+        ImageView view = frameView(cfg, buffers[i]);
+        if (!view.isValid())
+            return EXIT_FAILURE;
 
-        std::cout << " size " << width << "x" << height << " stride " << stride << " format " << cfg.pixelFormat.toString() << " sec "
-                  << (double)clock() / CLOCKS_PER_SEC << std::endl;
+        /* Subscribers must let go of a buffer before the camera gets it back. */
+        FrameSlot::Recycler recycle = recycler;
+        if (publisher)
+            recycle = [this, i, recycler](Request *request, FrameBuffer *buffer) {
+                publisher->retire(i);
+                recycler(request, buffer);
+            };
 
-        libcamera::MappedFrameBuffer mappedBuffer(buffer, MappedFrameBuffer::MapFlag::Read);
-        const std::vector<libcamera::Span<uint8_t>> mem = mappedBuffer.planes();
-        cv::Mat image(height, width, CV_8UC1, (uint8_t *)(mem[0].data()));
-        // static int i = 0;
-        cv::imwrite("images/img" + std::to_string((double)clock() / CLOCKS_PER_SEC) + ".png", image);
+        Request *request = i < requests.size() ? requests[i].get() : nullptr;
+        slots.push_back(std::make_unique<FrameSlot>(request, buffers[i], std::move(view), std::move(recycle), mappings.find(buffers[i])));
     }
 
+    deadlines.resize(slots.size());
+    deadlines.setCancelCallback([this](unsigned int index) { cancelFrame(index); });
+
+    if (publisher && publisher->start(loop, cfg, buffers) < 0)
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+ImageView SimpleCam::frameView(const StreamConfiguration &cfg, const FrameBuffer *buffer)
+{
+    const MappedFrameBuffer *mappedBuffer = mappings.find(buffer);
+    if (!mappedBuffer)
+    {
+        std::cerr << "No mapping for buffer " << (void *)buffer << std::endl;
+        return {};
+    }
+
+    ImageView view(mappedBuffer->planes(), cfg.pixelFormat, cfg.size, cfg.stride);
+    if (!view.isValid())
+        std::cerr << "Can't view " << cfg.pixelFormat.toString() << " buffer " << (void *)buffer << std::endl;
+
+    return view;
+}
+
+/*
+ * Queue the BGR conversion of a frame to the image writer. Returns false if
+ * the writer dropped an image to make room or rejected this one.
+ */
+bool SimpleCam::saveImage(const Frame &frame, const std::string &filename)
+{
+    if (!frame.view().isValid())
+        return false;
+
+    /* Don't even convert an image the writer won't have room for. */
+    const cv::Mat &plane = frame.view().plane(0);
+    if (!budget.fits(static_cast<size_t>(plane.rows) * plane.cols * 3))
+    {
+        stats.dropped(FrameStats::Drop::OverBudget);
+        return false;
+    }
+
+    /*
+     * The writer outlives the frame, so detach the image from the camera
+     * buffer unless the conversion already did (a Mat wrapping external
+     * memory has no UMatData).
+     */
+    cv::Mat image;
+    image.allocator = &matPool;
+    if (!frame.view().toBGR(image))
+        return false;
+    if (!image.u)
+    {
+        cv::Mat copy;
+        copy.allocator = &matPool;
+        image.copyTo(copy);
+        image = copy;
+    }
+
+    switch (writer.write(filename, std::move(image)))
+    {
+    case ImageWriter::Result::Queued:
+        return true;
+    case ImageWriter::Result::OverBudget:
+        stats.dropped(FrameStats::Drop::OverBudget);
+        return false;
+    case ImageWriter::Result::Evicted:
+    case ImageWriter::Result::Rejected:
+        break;
+    }
+
+    stats.dropped(FrameStats::Drop::WriterOverflow);
+    return false;
+}
+
+/*
+ * --------------------------------------------------------------------
+ * Synthetic source
+ *
+ * Completed synthetic buffers take the same route as Requests: accounted
+ * for in the completing thread, delivered as Frames on the EventLoop, and
+ * queued back when the last Frame is released.
+ */
+void SimpleCam::syntheticComplete(FrameBuffer *buffer, const FrameMetadata &metadata)
+{
+    stats.completed(metadata, synthetic->queued());
+
+    framesHeld.fetch_add(1, std::memory_order_relaxed);
+    FrameSlot *slot = slots[buffer->cookie()].get();
+    slot->begin();
+    deadlines.watch(buffer->cookie(), slot, metadata);
+
+    /*
+     * Keep the metadata with the buffer rather than in the call, so that
+     * the call fits a Task's inline storage and nothing is allocated.
+     */
+    syntheticMetadata[buffer->cookie()] = metadata;
+    loop.callLater([this, buffer]() { processSynthetic(buffer); }, EventLoop::Priority::Bulk);
+}
+
+void SimpleCam::processSynthetic(FrameBuffer *buffer)
+{
+    deliverFrame(Frame(slots[buffer->cookie()].get(), syntheticMetadata[buffer->cookie()]));
+}
+
+int SimpleCam::startSynthetic()
+{
+    int ret = synthetic->allocate();
+    if (ret < 0)
+    {
+        std::cerr << "Can't allocate synthetic buffers" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Synthetic configuration is: " << synthetic->configuration().toString() << std::endl;
+
+    ret = mappings.map(synthetic->buffers(), MappedFrameBuffer::MapFlag::Read);
+    if (ret < 0)
+    {
+        std::cerr << "Can't map buffers" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<FrameBuffer *> buffers;
+    for (const std::unique_ptr<FrameBuffer> &buffer : synthetic->buffers())
+        buffers.push_back(buffer.get());
+    syntheticMetadata.resize(buffers.size());
+
+    ret = createSlots(synthetic->configuration(), buffers, [this](Request *, FrameBuffer *buffer) {
+        deadlines.done(buffer->cookie());
+        frameRecycled();
+        if (streaming.load(std::memory_order_acquire))
+            synthetic->queueBuffer(buffer);
+    });
+    if (ret)
+        return ret;
+
+    aThread = std::make_unique<std::thread>([&]() { loop.exec(); });
+    return EXIT_SUCCESS;
+}
+
+/*
+ * --------------------------------------------------------------------
+ * Latest-frame pull API
+ *
+ * The EventLoop thread publishes each delivered Frame in latestFrame,
+ * recycling the one it replaces. grab() moves the latest Frame to
+ * grabbedFrame, where it stays until retrieve() or the next grab().
+ */
+void SimpleCam::publishLatest(Frame frame)
+{
+    Frame stale;
+    {
+        std::unique_lock<std::mutex> locker(latestLock);
+        stale = std::move(latestFrame);
+        latestFrame = std::move(frame);
+    }
+    latestAvailable.notify_one();
+
+    /* Dropping the stale Frame outside the lock recycles it. */
+    if (stale)
+        stats.dropped(FrameStats::Drop::SlowConsumer);
+}
+
+/*
+ * Let go of a frame that overran its hard deadline, if it is still ours.
+ * Only the pull API's reference can be dropped here: Frames held by onFrame
+ * consumers can't be revoked while they may still read the buffer, so those
+ * are only flagged cancelled and the buffer returns to the camera when they
+ * let go. Images queued to the writer are copies and hold no Frame.
+ */
+void SimpleCam::cancelFrame(unsigned int index)
+{
+    Frame stale;
+    {
+        std::unique_lock<std::mutex> locker(latestLock);
+        if (latestFrame && latestFrame.slot() == slots[index].get())
+            stale = std::move(latestFrame);
+    }
+
+    if (stale)
+        stats.dropped(FrameStats::Drop::SlowConsumer);
+}
+
+bool SimpleCam::grab(std::chrono::milliseconds timeout)
+{
+    Frame previous;
+    {
+        std::unique_lock<std::mutex> locker(latestLock);
+        if (!latestAvailable.wait_for(locker, timeout, [&] { return static_cast<bool>(latestFrame); }))
+            return false;
+
+        previous = std::move(grabbedFrame);
+        grabbedFrame = std::move(latestFrame);
+    }
+
+    return true;
+}
+
+bool SimpleCam::tryGrab()
+{
+    return grab(std::chrono::milliseconds(0));
+}
+
+bool SimpleCam::retrieve(Frame &frame)
+{
+    std::unique_lock<std::mutex> locker(latestLock);
+    frame = std::move(grabbedFrame);
+    return static_cast<bool>(frame);
+}
+
+bool SimpleCam::retrieve(cv::Mat &image, FrameMetadata *metadata)
+{
+    Frame frame;
+    if (!retrieve(frame) || !frame.view().toBGR(image))
+        return false;
+
+    /* The Frame goes back to the camera, keep the pixels. */
+    if (!image.u)
+        image = image.clone();
+    if (metadata)
+        *metadata = frame.metadata();
+
+    return true;
+}
+
+bool SimpleCam::read(cv::Mat &image, std::chrono::milliseconds timeout)
+{
+    return grab(timeout) && retrieve(image);
+}
+
+bool SimpleCam::tryRead(cv::Mat &image)
+{
+    return tryGrab() && retrieve(image);
+}
+
+/*
+ * --------------------------------------------------------------------
+ * Request recycling
+ *
+ * A Request is owned by the camera between queueRequest() and its completion,
+ * and by the application from completion until releaseRequest(). Only the
+ * camera side is counted as in flight.
+ */
+void SimpleCam::queueRequest(Request *request)
+{
+    inFlight.fetch_add(1, std::memory_order_relaxed);
+    if (camera->queueRequest(request) < 0)
+    {
+        inFlight.fetch_sub(1, std::memory_order_relaxed);
+        std::cerr << "Can't queue request " << (void *)request << std::endl;
+    }
+}
+
+void SimpleCam::releaseRequest(Request *request)
+{
+    if (!streaming.load(std::memory_order_acquire))
+        return;
+
     /* Re-queue the Request to the camera. */
     request->reuse(Request::ReuseBuffers);
-    // camera->queueRequest(request);
+    queueRequest(request);
 }
 
 /*
@@ -142,8 +481,22 @@ std::string SimpleCam::cameraName(Camera *camera)
 }
 void h(Request *r) { std::cout << "C\n"; };
 
+void SimpleCam::useBudget()
+{
+    mappings.setBudget(&budget);
+    matPool.setBudget(&budget);
+    writer.setBudget(&budget);
+    if (publisher)
+        publisher->setBudget(&budget);
+}
+
 int SimpleCam::start()
 {
+    useBudget();
+
+    if (synthetic)
+        return startSynthetic();
+
     /*
      * --------------------------------------------------------------------
      * Create a Camera Manager.
@@ -275,8 +628,7 @@ int SimpleCam::start()
      * The Camera configuration procedure fails with invalid parameters.
      */
     // #if 0
-    streamConfig.size.width = 2592;  // 4096
-    streamConfig.size.height = 1944; // 2560
+    streamConfig.size = size;
     // streamConfig.stream->
 
     int retconfig = camera->configure(config.get());
@@ -339,20 +691,35 @@ int SimpleCam::start()
      * buffers allocated in the Camera using a FrameBufferAllocator
      * instance and referencing a configured Camera to determine the
      * appropriate buffer size and types to create.
+     *
+     * simple-cam does the former when a BufferPool is set, and the latter
+     * otherwise.
      */
-    allocator = new FrameBufferAllocator(camera);
+    if (!pool)
+        allocator = new FrameBufferAllocator(camera);
 
     for (StreamConfiguration &cfg : *config)
     {
-        int ret = allocator->allocate(cfg.stream());
+        int ret = pool ? pool->allocate(cfg) : allocator->allocate(cfg.stream());
         if (ret < 0)
         {
             std::cerr << "Can't allocate buffers" << std::endl;
             return EXIT_FAILURE;
         }
 
-        size_t allocated = allocator->buffers(cfg.stream()).size();
-        std::cout << "Allocated " << allocated << " buffers for stream" << std::endl;
+        const std::vector<std::unique_ptr<FrameBuffer>> &allocated = pool ? pool->buffers(cfg.stream()) : allocator->buffers(cfg.stream());
+        std::cout << "Allocated " << allocated.size() << " buffers for stream" << std::endl;
+
+        /*
+         * The buffers stay the same for the lifetime of the allocator, so
+         * map them once here rather than for every completed frame.
+         */
+        ret = mappings.map(allocated, MappedFrameBuffer::MapFlag::Read);
+        if (ret < 0)
+        {
+            std::cerr << "Can't map buffers" << std::endl;
+            return EXIT_FAILURE;
+        }
     }
 
     /*
@@ -374,10 +741,10 @@ int SimpleCam::start()
      * properties that reports the capture parameters applied to the image.
      */
     stream = streamConfig.stream();
-    const std::vector<std::unique_ptr<FrameBuffer>> &buffers = allocator->buffers(stream);
+    const std::vector<std::unique_ptr<FrameBuffer>> &buffers = pool ? pool->buffers(stream) : allocator->buffers(stream);
     for (unsigned int i = 0; i < buffers.size(); ++i)
     {
-        std::unique_ptr<Request> request = camera->createRequest();
+        std::unique_ptr<Request> request = camera->createRequest(i);
         if (!request)
         {
             std::cerr << "Can't create request" << std::endl;
@@ -411,6 +778,21 @@ int SimpleCam::start()
         requests.push_back(std::move(request));
     }
 
+    /*
+     * Each Request always carries the same buffer, so one FrameSlot serves
+     * both, found from the Request cookie on completion.
+     */
+    std::vector<FrameBuffer *> slotBuffers;
+    for (const std::unique_ptr<FrameBuffer> &buffer : buffers)
+        slotBuffers.push_back(buffer.get());
+
+    if (createSlots(stream->configuration(), slotBuffers, [this](Request *request, FrameBuffer *) {
+            deadlines.done(request->cookie());
+            releaseRequest(request);
+            frameRecycled();
+        }))
+        return EXIT_FAILURE;
+
     /*
      * --------------------------------------------------------------------
      * Signal&Slots
@@ -430,7 +812,7 @@ int SimpleCam::start()
      * applications shall connecte a Slot to the Camera 'requestCompleted'
      * Signal before the camera is started.
      */
-    camera->requestCompleted.connect(requestComplete);
+    camera->requestCompleted.connect(this, &SimpleCam::requestComplete);
 
     /*
      * --------------------------------------------------------------------
@@ -451,6 +833,15 @@ int SimpleCam::start()
 // std::unique_ptr<Request> request;
 int SimpleCam::go()
 {
+    if (synthetic)
+    {
+        for (const std::unique_ptr<FrameBuffer> &buffer : synthetic->buffers())
+            synthetic->queueBuffer(buffer.get());
+
+        synthetic->start(std::bind(&SimpleCam::syntheticComplete, this, std::placeholders::_1, std::placeholders::_2));
+        return EXIT_SUCCESS;
+    }
+
     // const std::vector<std::unique_ptr<FrameBuffer>> &buffers = allocator->buffers(stream);
     // // int i = 0;
     // for (unsigned int i = 0; i < buffers.size(); ++i)
@@ -492,7 +883,7 @@ int SimpleCam::go()
     for (std::unique_ptr<Request> &request : requests)
     {
         std::cout << "Queued " << (void *)request.get() << std::endl;
-        camera->queueRequest(request.get());
+        queueRequest(request.get());
     }
 
     /*
@@ -511,7 +902,48 @@ int SimpleCam::go()
 
 int SimpleCam::finish()
 {
-    aThread->join();
+    using namespace std::chrono;
+
+    steady_clock::time_point deadline = steady_clock::now() + shutdownBudget;
+
+    /*
+     * --------------------------------------------------------------------
+     * Drain
+     *
+     * Stop giving buffers back to the source and let go of the frames kept
+     * for the pull API and the subscribers, then wait for what is in flight to complete and be
+     * processed, and for the images to be written.
+     */
+    streaming.store(false, std::memory_order_release);
+
+#ifdef SIMPLE_CAM_COROUTINES
+    loop.callLater([this]() { frames.close(); });
+#endif
+    if (publisher)
+        loop.callLater([this]() { publisher->release(); });
+
+    {
+        Frame latest, grabbed;
+        {
+            std::unique_lock<std::mutex> locker(latestLock);
+            latest = std::move(latestFrame);
+            grabbed = std::move(grabbedFrame);
+        }
+    }
+
+    if (synthetic)
+        synthetic->stop();
+
+    bool drained = waitIdle(deadline);
+    if (drained)
+    {
+        milliseconds left = duration_cast<milliseconds>(deadline - steady_clock::now());
+        drained = writer.flush(std::max(left, milliseconds(0)));
+    }
+
+    if (!drained)
+        std::cerr << "Shutdown budget exceeded: " << requestsInFlight() << " requests in flight, "
+                  << framesHeld.load() << " frames held, " << writer.pending() << " images pending" << std::endl;
 
     /*
      * --------------------------------------------------------------------
@@ -520,12 +952,95 @@ int SimpleCam::finish()
      * Stop the Camera, release resources and stop the CameraManager.
      * libcamera has now released all resources it owned.
      */
-    camera->stop();
-    allocator->free(stream);
-    delete allocator;
+    if (!synthetic)
+        camera->stop();
+
+    loop.exit();
+    aThread->join();
+
+    writer.stop(drained);
+    if (publisher)
+        publisher->stop();
+
+    /*
+     * Frames still held past the budget point into their slot and mapped
+     * buffer. Detach them, so that releasing them no longer calls back into
+     * us, and leave their slots, mappings and buffers behind rather than
+     * free memory that may still be read.
+     */
+    unsigned int lost = 0;
+    for (std::unique_ptr<FrameSlot> &slot : slots)
+    {
+        if (slot->detach())
+        {
+            slot.release();
+            lost++;
+        }
+    }
+    slots.clear();
+
+    if (lost)
+    {
+        std::cerr << "Detached " << lost << " frames still held, leaving their buffers mapped" << std::endl;
+        mappings.abandon();
+    }
+    else
+    {
+        mappings.clear();
+    }
+
+    std::cout << "Capture stats: " << stats.toString() << std::endl;
+    std::cout << "Mat pool: " << matPool.stats().toString() << std::endl;
+    std::cout << "Memory: " << budget.toString() << std::endl;
+
+    if (synthetic)
+    {
+        if (lost)
+            synthetic.release();
+        else
+            synthetic->free();
+        return EXIT_SUCCESS;
+    }
+
+    if (lost)
+    {
+        pool.release();
+        allocator = nullptr;
+    }
+    else if (pool)
+    {
+        pool->free();
+    }
+    else
+    {
+        allocator->free(stream);
+        delete allocator;
+        allocator = nullptr;
+    }
     camera->release();
     camera.reset();
     cm->stop();
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
+
+/*
+ * Wait until the camera has no Request left and every completed frame has
+ * been recycled, or until \a deadline.
+ */
+bool SimpleCam::waitIdle(std::chrono::steady_clock::time_point deadline)
+{
+    std::unique_lock<std::mutex> locker(idleLock);
+    return idleCond.wait_until(locker, deadline, [&] {
+        return inFlight.load(std::memory_order_acquire) == 0 && framesHeld.load(std::memory_order_acquire) == 0;
+    });
+}
+
+void SimpleCam::frameRecycled()
+{
+    if (framesHeld.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    std::unique_lock<std::mutex> locker(idleLock);
+    idleCond.notify_all();
+}
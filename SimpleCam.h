@@ -7,15 +7,32 @@
  * A simple libcamera capture example
  */
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <thread>
 
 #include <libcamera/libcamera.h>
 #include <opencv2/opencv.hpp>
 
+#include "buffer_pool.h"
+#include "deadline_monitor.h"
+#include "frame.h"
+#include "frame_publisher.h"
+#include "frame_stats.h"
+#include "frame_stream.h"
+#include "image_view.h"
+#include "image_writer.h"
+#include "mapped_buffer_cache.h"
 #include "mapped_framebuffer.h"
+#include "mat_pool.h"
+#include "memory_budget.h"
+#include "synthetic_camera.h"
 
 #include "event_loop.h"
 
@@ -26,20 +43,147 @@ using namespace libcamera;
 class SimpleCam
 {
 public:
+    /*
+     * Called on the EventLoop thread for each completed frame. Take a
+     * reference with Frame::share() to keep the frame past the call; its
+     * buffer only goes back to the camera once every reference is gone.
+     */
+    using FrameCallback = std::function<void(const Frame &frame)>;
 
-    static void processRequest(Request *request);
-    static void requestComplete(Request *request);
+    void setFrameCallback(FrameCallback callback) { onFrame = std::move(callback); }
+    bool saveImage(const Frame &frame, const std::string &filename);
+
+    /*
+     * Latest-frame pull API, modelled on cv::VideoCapture. With keepLatest
+     * set, the newest completed frame is held back for grab() and the one
+     * it replaces is recycled at once, so a slow reader only ever misses
+     * frames and never stalls the camera. retrieve() hands over the grabbed
+     * Frame, or converts it to BGR and gives it back. Meant for a single
+     * reader.
+     */
+    bool grab(std::chrono::milliseconds timeout);
+    bool tryGrab();
+    bool retrieve(Frame &frame);
+    bool retrieve(cv::Mat &image, FrameMetadata *metadata = nullptr);
+    bool read(cv::Mat &image, std::chrono::milliseconds timeout);
+    bool tryRead(cv::Mat &image);
+
+#ifdef SIMPLE_CAM_COROUTINES
+    /*
+     * Coroutine interface, with -DSIMPLE_CAM_COROUTINES=ON: `Frame frame =
+     * co_await cam.nextFrame();` from a coroutine started on the EventLoop
+     * thread resumes with the next completed frame, after the frame
+     * callback has run. The Frame is empty once finish() has started.
+     */
+    FrameStream::Awaiter nextFrame() { return frames.next(); }
+    FrameStream frames;
+#endif
+
+    ImageView frameView(const StreamConfiguration &cfg, const FrameBuffer *buffer);
+    int createSlots(const StreamConfiguration &cfg, const std::vector<FrameBuffer *> &buffers, FrameSlot::Recycler recycler);
+    void deliverFrame(Frame frame);
+    void processRequest(Request *request);
+    void requestComplete(Request *request);
     std::string cameraName(Camera *camera);
 
     int start();
     int go();
     int finish();
 
+    /*
+     * Requests are handed to the camera with queueRequest() and given back
+     * by their consumers with releaseRequest(). In streaming mode a released
+     * Request is re-queued at once, so the camera can never run ahead of the
+     * slowest consumer: if consumers hold on to every Request the pipeline
+     * stalls (and the sensor drops frames) instead of memory growing.
+     */
+    void queueRequest(Request *request);
+    void releaseRequest(Request *request);
+    void publishLatest(Frame frame);
+    void cancelFrame(unsigned int index);
+    unsigned int requestsInFlight() const { return inFlight.load(std::memory_order_relaxed); }
+
+    Size size{2592, 1944};
+    FrameCallback onFrame;
+
+    bool keepLatest = false;
+    std::mutex latestLock;
+    std::condition_variable latestAvailable;
+    Frame latestFrame;
+    Frame grabbedFrame;
+
+    /*
+     * finish() stops queueing Requests, waits for those in flight to
+     * complete and for all frames to be released and written, then stops
+     * the camera. Whatever is left when the budget runs out is cancelled.
+     */
+    std::chrono::milliseconds shutdownBudget{500};
+    bool waitIdle(std::chrono::steady_clock::time_point deadline);
+    void frameRecycled();
+
+    std::mutex idleLock;
+    std::condition_variable idleCond;
+    std::atomic<unsigned int> framesHeld{0};
+
+    /*
+     * Cleared by finish(), read from the CameraManager, EventLoop and
+     * consumer threads.
+     */
+    std::atomic<bool> streaming{true};
+    std::atomic<unsigned int> inFlight{0};
+    std::atomic<uint64_t> starved{0};
+    FrameStats stats;
+
+    /*
+     * When set before start(), frames come from this source instead of the
+     * first camera of the system.
+     */
+    std::unique_ptr<SyntheticCamera> synthetic;
+    int startSynthetic();
+    void syntheticComplete(FrameBuffer *buffer, const FrameMetadata &metadata);
+    void processSynthetic(FrameBuffer *buffer);
+    /* Per buffer, like FrameBuffer::metadata() for camera buffers. */
+    std::vector<FrameMetadata> syntheticMetadata;
+
+    /*
+     * Memory pinned by the capture path: buffer mappings, the Mat pool, the
+     * writer queue and the shared frame ring. Set a limit to shed images
+     * and pooled memory before the system runs out. Declared ahead of
+     * everything it accounts for, so that it outlives them.
+     */
+    MemoryBudget budget;
+    void useBudget();
+
+    /*
+     * When set before start(), the camera captures into buffers from this
+     * pool instead of ones exported by a FrameBufferAllocator.
+     */
+    std::unique_ptr<BufferPool> pool;
+
+    /*
+     * When set before start(), completed frames are also shared with
+     * FrameSubscribers in other processes, before the frame callback runs.
+     */
+    std::unique_ptr<FramePublisher> publisher;
+
     std::shared_ptr<Camera> camera;
     EventLoop loop;
+
+    /*
+     * Disabled by default, enable with deadlines.configure() before
+     * start(). Overdue frames are dropped from the latest-frame slot and
+     * skipped by deliverFrame() when cancelled.
+     */
+    DeadlineMonitor deadlines{loop};
     std::unique_ptr<std::thread> aThread;
     Stream *stream;
-    FrameBufferAllocator *allocator;
+    FrameBufferAllocator *allocator = nullptr;
+    MappedBufferCache mappings;
+    std::vector<std::unique_ptr<FrameSlot>> slots;
+
+    /* Images converted for saving come from here, and must go before it. */
+    MatPool matPool;
+    ImageWriter writer;
     std::unique_ptr<CameraManager> cm;
     std::vector<std::unique_ptr<Request>> requests;
 };
\ No newline at end of file
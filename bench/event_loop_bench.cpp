@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * event_loop_bench.cpp - EventLoop::callLater throughput
+ *
+ * Posts a fixed number of trivial calls from 1, 2 and 4 producer threads and
+ * reports how many calls per second the loop thread runs, and how many times
+ * it had to be woken up for them.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include "event_loop.h"
+
+static double run(unsigned int producers, unsigned int calls, uint64_t &wakeups)
+{
+	EventLoop loop;
+	std::atomic<uint64_t> done{ 0 };
+	uint64_t total = static_cast<uint64_t>(producers) * calls;
+
+	std::thread consumer([&]() { loop.exec(); });
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < producers; ++i) {
+		threads.emplace_back([&]() {
+			for (unsigned int n = 0; n < calls; ++n)
+				loop.callLater([&]() {
+					done.fetch_add(1, std::memory_order_relaxed);
+				});
+		});
+	}
+
+	for (std::thread &thread : threads)
+		thread.join();
+
+	while (done.load(std::memory_order_relaxed) < total)
+		std::this_thread::yield();
+
+	auto end = std::chrono::steady_clock::now();
+
+	loop.callLater([&]() { loop.exit(); });
+	consumer.join();
+
+	wakeups = loop.wakeups();
+
+	std::chrono::duration<double> elapsed = end - start;
+	return total / elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int calls = argc > 1 ? atoi(argv[1]) : 1000000;
+
+	for (unsigned int producers : { 1, 2, 4 }) {
+		uint64_t wakeups;
+		double rate = run(producers, calls, wakeups);
+
+		std::cout << producers << " producer(s): " << std::fixed
+			  << std::setprecision(0) << rate << " calls/s, "
+			  << wakeups << " wakeups" << std::endl;
+	}
+
+	return 0;
+}
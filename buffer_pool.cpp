@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * buffer_pool.cpp - FrameBuffers backed by application allocated memory
+ */
+
+#include "buffer_pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <linux/udmabuf.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "image_view.h"
+
+using namespace libcamera;
+
+namespace {
+
+/*
+ * The size of the huge pages MFD_HUGETLB hands out when not given one, as
+ * reported by the kernel, or 0 if it has none.
+ */
+size_t defaultHugePageSize()
+{
+	std::ifstream meminfo("/proc/meminfo");
+	std::string line;
+
+	while (std::getline(meminfo, line)) {
+		unsigned long size;
+		if (sscanf(line.c_str(), "Hugepagesize: %lu kB", &size) == 1)
+			return size * 1024;
+	}
+
+	return 0;
+}
+
+const std::vector<std::unique_ptr<FrameBuffer>> noBuffers;
+
+} /* namespace */
+
+BufferPool::BufferPool(Backing backing, bool hugePages)
+	: backing_(backing), hugePages_(hugePages),
+	  hugePageSize_(hugePages ? defaultHugePageSize() : 0)
+{
+}
+
+BufferPool::~BufferPool()
+{
+	free();
+}
+
+/*
+ * Allocate cfg.bufferCount buffers for frames of cfg, leaving the buffers of
+ * other streams alone. Returns 0, -EBUSY if the stream already has buffers,
+ * or another negative error code.
+ */
+int BufferPool::allocate(const StreamConfiguration &cfg)
+{
+	std::vector<std::unique_ptr<FrameBuffer>> &buffers = buffers_[cfg.stream()];
+	if (!buffers.empty())
+		return -EBUSY;
+
+	std::vector<size_t> sizes = ImageView::planeSizes(cfg.pixelFormat,
+							   cfg.size, cfg.stride);
+	if (sizes.empty()) {
+		std::cerr << "Can't lay out " << cfg.pixelFormat.toString()
+			  << " buffers" << std::endl;
+		return -EINVAL;
+	}
+
+	size_t frameSize = 0;
+	for (size_t length : sizes)
+		frameSize += length;
+
+	for (unsigned int i = 0; i < cfg.bufferCount; ++i) {
+		int fd = createFd(frameSize);
+		if (fd < 0) {
+			std::cerr << "Can't create buffer: " << strerror(-fd)
+				  << std::endl;
+			buffers.clear();
+			return fd;
+		}
+
+		FileDescriptor bufferFd(fd);
+		close(fd);
+
+		std::vector<FrameBuffer::Plane> planes;
+		unsigned int offset = 0;
+		for (size_t length : sizes) {
+			FrameBuffer::Plane plane;
+			plane.fd = bufferFd;
+			plane.offset = offset;
+			plane.length = length;
+			planes.push_back(plane);
+			offset += length;
+		}
+
+		buffers.push_back(std::make_unique<FrameBuffer>(planes, i));
+	}
+
+	return 0;
+}
+
+/* Free the buffers of every stream. */
+void BufferPool::free()
+{
+	buffers_.clear();
+}
+
+const std::vector<std::unique_ptr<FrameBuffer>> &
+BufferPool::buffers(const Stream *stream) const
+{
+	auto it = buffers_.find(stream);
+	if (it == buffers_.end())
+		return noBuffers;
+
+	return it->second;
+}
+
+/* Return an fd for a new buffer of at least \a size bytes, or -errno. */
+int BufferPool::createFd(size_t size)
+{
+	unsigned int flags = MFD_CLOEXEC;
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+
+	if (backing_ == Backing::Udmabuf)
+		flags |= MFD_ALLOW_SEALING;
+	if (hugePages_) {
+		if (!hugePageSize_)
+			return -EOPNOTSUPP;
+
+		flags |= MFD_HUGETLB;
+		pageSize = hugePageSize_;
+	}
+
+	/* Sizes are rounded up to whole pages, as udmabuf and hugetlbfs want. */
+	size = (size + pageSize - 1) / pageSize * pageSize;
+
+	int memfd = memfd_create("simple-cam", flags);
+	if (memfd < 0)
+		return -errno;
+
+	if (ftruncate(memfd, size) < 0) {
+		int ret = -errno;
+		close(memfd);
+		return ret;
+	}
+
+	if (backing_ == Backing::Memfd)
+		return memfd;
+
+	/* udmabuf only accepts memfds that can't shrink under the dmabuf. */
+	if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+		int ret = -errno;
+		close(memfd);
+		return ret;
+	}
+
+	int device = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+	if (device < 0) {
+		int ret = -errno;
+		close(memfd);
+		return ret;
+	}
+
+	struct udmabuf_create create = {};
+	create.memfd = memfd;
+	create.flags = UDMABUF_FLAGS_CLOEXEC;
+	create.offset = 0;
+	create.size = size;
+
+	int dmabuf = ioctl(device, UDMABUF_CREATE, &create);
+	int ret = dmabuf < 0 ? -errno : dmabuf;
+
+	/* The dmabuf keeps the pages, the memfd isn't needed anymore. */
+	close(device);
+	close(memfd);
+
+	return ret;
+}
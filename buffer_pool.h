@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * buffer_pool.h - FrameBuffers backed by application allocated memory
+ */
+#ifndef __SIMPLE_CAM_BUFFER_POOL_H__
+#define __SIMPLE_CAM_BUFFER_POOL_H__
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <libcamera/framebuffer.h>
+#include <libcamera/stream.h>
+
+/*
+ * Allocates the buffers of a stream from memory owned by the application,
+ * in place of a FrameBufferAllocator, so that frames land directly where
+ * their consumers want them. Buffers are laid out the way libcamera lays out
+ * its own: one fd per buffer, one FrameBuffer::Plane per image plane, at the
+ * stride of the stream configuration. Like a FrameBufferAllocator, the pool
+ * holds the buffers of each stream apart, and their cookies are their index
+ * within the stream.
+ *
+ * Memfd buffers can be shared with other processes and mapped by anyone,
+ * but only dmabufs can be imported by V4L2 devices: use Udmabuf for a real
+ * camera. Udmabuf buffers are memfds turned into dmabufs by /dev/udmabuf,
+ * and need the kernel's CONFIG_UDMABUF and access to the device. Either can
+ * be backed by huge pages of the system's default size, which must then be
+ * reserved.
+ */
+class BufferPool
+{
+public:
+	enum class Backing {
+		Memfd,
+		Udmabuf,
+	};
+
+	explicit BufferPool(Backing backing = Backing::Udmabuf,
+			    bool hugePages = false);
+	~BufferPool();
+
+	int allocate(const libcamera::StreamConfiguration &cfg);
+	void free();
+
+	Backing backing() const { return backing_; }
+	const std::vector<std::unique_ptr<libcamera::FrameBuffer>> &
+	buffers(const libcamera::Stream *stream = nullptr) const;
+
+private:
+	int createFd(size_t size);
+
+	const Backing backing_;
+	const bool hugePages_;
+	/* 0 if huge pages weren't asked for or aren't supported. */
+	const size_t hugePageSize_;
+	std::map<const libcamera::Stream *,
+		 std::vector<std::unique_ptr<libcamera::FrameBuffer>>> buffers_;
+};
+
+#endif /* __SIMPLE_CAM_BUFFER_POOL_H__ */
@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * deadline_monitor.cpp - Per-frame processing deadlines
+ */
+
+#include "deadline_monitor.h"
+
+#include <algorithm>
+#include <iostream>
+#include <time.h>
+
+using namespace libcamera;
+
+namespace {
+
+uint64_t monotonicNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+const char *stageName(FrameStage stage)
+{
+	switch (stage) {
+	case FrameStage::Idle:
+		return "idle";
+	case FrameStage::Queued:
+		return "queued";
+	case FrameStage::Processing:
+		return "processing";
+	case FrameStage::Held:
+		return "held";
+	}
+
+	return "unknown";
+}
+
+} /* namespace */
+
+DeadlineMonitor::DeadlineMonitor(EventLoop &loop)
+	: loop_(loop), soft_(0), hard_(0), cancelOverdue_(false), size_(0),
+	  overruns_(0), cancellations_(0)
+{
+}
+
+/*
+ * Set the deadlines, a zero duration disabling the corresponding one. Must
+ * be called before frames are watched.
+ */
+void DeadlineMonitor::configure(std::chrono::microseconds soft,
+				std::chrono::microseconds hard,
+				bool cancelOverdue)
+{
+	soft_ = soft;
+	hard_ = hard;
+	cancelOverdue_ = cancelOverdue;
+}
+
+/* Size the monitor for \a slots frame slots. Must not race with watch(). */
+void DeadlineMonitor::resize(unsigned int slots)
+{
+	entries_ = std::make_unique<Entry[]>(slots);
+	size_ = slots;
+}
+
+/* Start the deadlines of the frame completed in slot \a index. */
+void DeadlineMonitor::watch(unsigned int index, FrameSlot *slot,
+			    const FrameMetadata &metadata)
+{
+	if (index >= size_ || (!soft_.count() && !hard_.count()))
+		return;
+
+	Entry &entry = entries_[index];
+	uint32_t generation = entry.generation.load(std::memory_order_relaxed);
+
+	entry.slot = slot;
+	entry.sequence = metadata.sequence;
+	entry.timestamp = metadata.timestamp ? metadata.timestamp : monotonicNow();
+
+	uint64_t now = monotonicNow();
+	std::chrono::microseconds age((now > entry.timestamp ? now - entry.timestamp : 0) / 1000);
+
+	std::chrono::microseconds deadlines[2] = { soft_, hard_ };
+	for (unsigned int i = 0; i < 2; ++i) {
+		if (!deadlines[i].count())
+			continue;
+
+		bool hard = i == 1;
+		std::chrono::microseconds delay = std::max(deadlines[i] - age,
+							   std::chrono::microseconds(0));
+		entry.timers[i] = loop_.addTimer(delay, [this, index, generation, hard]() {
+			expired(index, generation, hard);
+		});
+	}
+}
+
+/* The frame in slot \a index has been recycled, drop its deadlines. */
+void DeadlineMonitor::done(unsigned int index)
+{
+	if (index >= size_)
+		return;
+
+	Entry &entry = entries_[index];
+	entry.generation.fetch_add(1, std::memory_order_release);
+
+	for (EventLoop::TimerId &timer : entry.timers) {
+		if (timer)
+			loop_.cancelTimer(timer);
+		timer = 0;
+	}
+}
+
+void DeadlineMonitor::expired(unsigned int index, uint32_t generation, bool hard)
+{
+	Entry &entry = entries_[index];
+	if (entry.generation.load(std::memory_order_acquire) != generation)
+		return;
+
+	overruns_.fetch_add(1, std::memory_order_relaxed);
+
+	Overrun overrun;
+	overrun.index = index;
+	overrun.sequence = entry.sequence;
+	overrun.stage = entry.slot->stage();
+	overrun.age = std::chrono::microseconds((monotonicNow() - entry.timestamp) / 1000);
+	overrun.hard = hard;
+
+	if (onOverrun_)
+		onOverrun_(overrun);
+	else
+		std::cerr << "Frame " << overrun.sequence << " overran its "
+			  << (hard ? "hard" : "soft") << " deadline while "
+			  << stageName(overrun.stage) << " ("
+			  << overrun.age.count() << "us since capture)"
+			  << std::endl;
+
+	if (hard && cancelOverdue_) {
+		cancellations_.fetch_add(1, std::memory_order_relaxed);
+		entry.slot->cancel();
+		if (onCancel_)
+			onCancel_(index);
+	}
+}
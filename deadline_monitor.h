@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * deadline_monitor.h - Per-frame processing deadlines
+ */
+#ifndef __SIMPLE_CAM_DEADLINE_MONITOR_H__
+#define __SIMPLE_CAM_DEADLINE_MONITOR_H__
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+
+#include <libcamera/framebuffer.h>
+
+#include "event_loop.h"
+#include "frame.h"
+
+/*
+ * Arms a soft and a hard deadline on the EventLoop for every completed frame,
+ * both measured from the capture timestamp in its FrameMetadata (on
+ * CLOCK_MONOTONIC). A frame whose buffer has not been recycled when a
+ * deadline expires is reported as an overrun, together with the stage it was
+ * in. Past the hard deadline, if cancellation is enabled, the frame is also
+ * marked cancelled and the cancel callback runs so that its holders can let
+ * go of it and the buffer returns to the camera quickly. Cancellation is a
+ * request, not a revocation: the buffer is only recycled once every holder
+ * has released its Frame.
+ *
+ * Frames are identified by the index of their FrameSlot. watch() and done()
+ * may be called from any thread, the callbacks run on the loop thread.
+ */
+class DeadlineMonitor
+{
+public:
+	struct Overrun {
+		unsigned int index;
+		unsigned int sequence;
+		FrameStage stage;
+		std::chrono::microseconds age;
+		bool hard;
+	};
+
+	using OverrunCallback = std::function<void(const Overrun &overrun)>;
+	using CancelCallback = std::function<void(unsigned int index)>;
+
+	DeadlineMonitor(EventLoop &loop);
+
+	void configure(std::chrono::microseconds soft, std::chrono::microseconds hard,
+		       bool cancelOverdue);
+	void resize(unsigned int slots);
+	void setOverrunCallback(OverrunCallback callback) { onOverrun_ = std::move(callback); }
+	void setCancelCallback(CancelCallback callback) { onCancel_ = std::move(callback); }
+
+	void watch(unsigned int index, FrameSlot *slot,
+		   const libcamera::FrameMetadata &metadata);
+	void done(unsigned int index);
+
+	uint64_t overruns() const { return overruns_.load(std::memory_order_relaxed); }
+	uint64_t cancellations() const { return cancellations_.load(std::memory_order_relaxed); }
+
+private:
+	struct Entry {
+		std::atomic<uint32_t> generation{ 0 };
+		FrameSlot *slot = nullptr;
+		unsigned int sequence = 0;
+		uint64_t timestamp = 0;
+		EventLoop::TimerId timers[2] = { 0, 0 };
+	};
+
+	void expired(unsigned int index, uint32_t generation, bool hard);
+
+	EventLoop &loop_;
+	std::chrono::microseconds soft_;
+	std::chrono::microseconds hard_;
+	bool cancelOverdue_;
+
+	std::unique_ptr<Entry[]> entries_;
+	unsigned int size_;
+
+	OverrunCallback onOverrun_;
+	CancelCallback onCancel_;
+
+	std::atomic<uint64_t> overruns_;
+	std::atomic<uint64_t> cancellations_;
+};
+
+#endif /* __SIMPLE_CAM_DEADLINE_MONITOR_H__ */
@@ -7,39 +7,62 @@
 
 #include "event_loop.h"
 
-#include <assert.h>
+#include <cstdlib>
+#include <sys/time.h>
 #include <event2/event.h>
 #include <event2/thread.h>
 
-EventLoop *EventLoop::instance_ = nullptr;
+/*
+ * Any number of loops may exist at once, each with its own event_base and
+ * typically its own thread. libevent's global state is set up by the first
+ * one and only torn down at exit, as libevent can't be used again once
+ * libevent_global_shutdown() has run.
+ */
+void EventLoop::initialize()
+{
+	static std::once_flag once;
+
+	std::call_once(once, []() {
+		evthread_use_pthreads();
+		std::atexit(libevent_global_shutdown);
+	});
+}
 
 EventLoop::EventLoop()
+	: wakeupPending_(false), wakeups_(0), wakeupsAvoided_(0), nextWatch_(1)
 {
-	assert(!instance_);
+	initialize();
 
-	evthread_use_pthreads();
 	event_ = event_base_new();
-	instance_ = this;
+	wakeup_ = event_new(event_, -1, 0, &wakeupTriggered, this);
 }
 
 EventLoop::~EventLoop()
 {
-	instance_ = nullptr;
+	/* Calls that never ran may still own events of this base. */
+	control_.clear();
+	bulk_.clear();
+	watches_.clear();
 
+	for (std::unique_ptr<Timer> &timer : timers_)
+		event_free(timer->event);
+	event_free(wakeup_);
 	event_base_free(event_);
-	libevent_global_shutdown();
 }
 
 int EventLoop::exec()
 {
 	exitCode_ = -1;
 	exit_.store(false, std::memory_order_release);
+	thread_.store(std::this_thread::get_id(), std::memory_order_release);
 
 	while (!exit_.load(std::memory_order_acquire)) {
 		dispatchCalls();
 		event_base_loop(event_, EVLOOP_NO_EXIT_ON_EMPTY);
 	}
 
+	thread_.store(std::thread::id(), std::memory_order_release);
+
 	return exitCode_;
 }
 
@@ -50,50 +73,395 @@ void EventLoop::exit(int code)
 	interrupt();
 }
 
+/*
+ * event_base_loopbreak() from another thread is lost if it lands before the
+ * loop thread re-enters event_base_loop(), which resets the break flag. An
+ * activated event stays pending until the loop runs it, so break from there.
+ *
+ * Only the first interrupt after the loop has started dispatching calls
+ * activates the event, later ones find the wakeup already pending. The flag
+ * is cleared before the calls are taken, so a call posted after that gets
+ * a wakeup of its own.
+ */
 void EventLoop::interrupt()
 {
-	event_base_loopbreak(event_);
-}
+	if (wakeupPending_.exchange(true, std::memory_order_acq_rel)) {
+		wakeupsAvoided_.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
 
+	wakeups_.fetch_add(1, std::memory_order_relaxed);
+	event_active(wakeup_, 0, 0);
+}
 
-void EventLoop::timeoutTriggered(int fd, short event, void *arg)
+void EventLoop::wakeupTriggered(int fd, short event, void *arg)
 {
 	EventLoop *self = static_cast<EventLoop *>(arg);
-	self->exit();
+	event_base_loopbreak(self->event_);
+}
+
+bool EventLoop::isLoopThread() const
+{
+	return thread_.load(std::memory_order_acquire) == std::this_thread::get_id();
 }
 
 void EventLoop::timeout(unsigned int sec)
 {
-	struct event *ev;
-	struct timeval tv;
+	addTimer(std::chrono::seconds(sec), [this]() { exit(); });
+}
+
+EventLoop::TimerId EventLoop::addTimer(std::chrono::microseconds delay, Task &&callback)
+{
+	return addTimer(delay, std::move(callback), false);
+}
+
+EventLoop::TimerId EventLoop::addPeriodicTimer(std::chrono::microseconds interval,
+					       Task &&callback)
+{
+	return addTimer(interval, std::move(callback), true);
+}
+
+EventLoop::TimerId EventLoop::addTimer(std::chrono::microseconds interval,
+				       Task &&callback, bool periodic)
+{
+	Timer *timer;
+	TimerId id;
+
+	{
+		std::unique_lock<std::mutex> locker(timerLock_);
+
+		if (freeTimers_.empty()) {
+			std::unique_ptr<Timer> slot = std::make_unique<Timer>();
+			slot->loop = this;
+			slot->event = event_new(event_, -1, 0, &timerTriggered, slot.get());
+			slot->index = timers_.size();
+			slot->generation = 0;
+			slot->state = Timer::State::Free;
+			timers_.push_back(std::move(slot));
+			freeTimers_.push_back(timers_.size() - 1);
+		}
+
+		timer = timers_[freeTimers_.back()].get();
+		freeTimers_.pop_back();
+
+		timer->generation++;
+		timer->state = Timer::State::Pending;
+		timer->periodic = periodic;
+		timer->interval = interval;
+		timer->callback = std::move(callback);
+
+		id = (static_cast<TimerId>(timer->generation) << 32) | (timer->index + 1);
+	}
+
+	if (isLoopThread())
+		armTimer(timer);
+	else
+		callLater([this, timer]() { armTimer(timer); });
+
+	return id;
+}
+
+bool EventLoop::cancelTimer(TimerId id)
+{
+	unsigned int index = static_cast<uint32_t>(id) - 1;
+	uint32_t generation = id >> 32;
+	Task callback;
+
+	{
+		std::unique_lock<std::mutex> locker(timerLock_);
+
+		if (index >= timers_.size())
+			return false;
+
+		Timer *timer = timers_[index].get();
+		if (timer->generation != generation)
+			return false;
+
+		switch (timer->state) {
+		case Timer::State::Free:
+		case Timer::State::Cancelled:
+			return false;
+
+		case Timer::State::Pending:
+			/* The queued armTimer() call frees it. */
+			timer->state = Timer::State::Cancelled;
+			break;
+
+		case Timer::State::Running:
+			/* fireTimer() frees it once the callback returns. */
+			timer->state = Timer::State::Cancelled;
+			break;
+
+		case Timer::State::Armed:
+			if (isLoopThread()) {
+				event_del(timer->event);
+				callback = freeTimer(timer);
+			} else {
+				timer->state = Timer::State::Cancelled;
+				callLater([this, timer]() { disarmTimer(timer); });
+			}
+			break;
+		}
+	}
+
+	return true;
+}
+
+void EventLoop::armTimer(Timer *timer)
+{
+	Task callback;
+
+	{
+		std::unique_lock<std::mutex> locker(timerLock_);
+
+		if (timer->state == Timer::State::Cancelled) {
+			callback = freeTimer(timer);
+			return;
+		}
+
+		struct timeval tv;
+		tv.tv_sec = timer->interval.count() / 1000000;
+		tv.tv_usec = timer->interval.count() % 1000000;
+
+		event_assign(timer->event, event_, -1,
+			     timer->periodic ? EV_PERSIST : 0,
+			     &timerTriggered, timer);
+		event_add(timer->event, &tv);
+		timer->state = Timer::State::Armed;
+	}
+}
+
+void EventLoop::disarmTimer(Timer *timer)
+{
+	Task callback;
+
+	std::unique_lock<std::mutex> locker(timerLock_);
+	event_del(timer->event);
+	callback = freeTimer(timer);
+}
+
+void EventLoop::timerTriggered(int fd, short event, void *arg)
+{
+	Timer *timer = static_cast<Timer *>(arg);
+	timer->loop->fireTimer(timer);
+}
+
+void EventLoop::fireTimer(Timer *timer)
+{
+	Task callback;
+
+	{
+		std::unique_lock<std::mutex> locker(timerLock_);
+		if (timer->state != Timer::State::Armed)
+			return;
+
+		timer->state = Timer::State::Running;
+	}
+
+	timer->callback();
+
+	std::unique_lock<std::mutex> locker(timerLock_);
+
+	if (timer->state == Timer::State::Cancelled) {
+		event_del(timer->event);
+		callback = freeTimer(timer);
+	} else if (!timer->periodic) {
+		callback = freeTimer(timer);
+	} else {
+		timer->state = Timer::State::Armed;
+	}
+}
+
+/*
+ * Return the slot to the free list. The callback is handed back so that the
+ * caller destroys it after dropping timerLock_.
+ */
+Task EventLoop::freeTimer(Timer *timer)
+{
+	timer->state = Timer::State::Free;
+	timer->generation++;
+	freeTimers_.push_back(timer->index);
+
+	return std::move(timer->callback);
+}
+
+EventLoop::WatchId EventLoop::watchFd(int fd, unsigned int events,
+				      FdCallback callback)
+{
+	short what = EV_PERSIST;
+	if (events & Readable)
+		what |= EV_READ;
+	if (events & Writable)
+		what |= EV_WRITE;
+
+	std::unique_ptr<Watch> watch = std::make_unique<Watch>();
+	watch->callback = std::move(callback);
+	watch->event = event_new(event_, fd, what, &watchTriggered, watch.get());
+	if (!watch->event)
+		return 0;
+
+	if (event_add(watch->event, nullptr) < 0)
+		return 0;
+
+	std::unique_lock<std::mutex> locker(watchLock_);
+	WatchId id = nextWatch_++;
+	watches_[id] = std::move(watch);
+
+	return id;
+}
+
+bool EventLoop::unwatchFd(WatchId id)
+{
+	std::unique_ptr<Watch> watch;
+	{
+		std::unique_lock<std::mutex> locker(watchLock_);
+		auto it = watches_.find(id);
+		if (it == watches_.end())
+			return false;
+
+		watch = std::move(it->second);
+		watches_.erase(it);
+	}
+
+	/*
+	 * From another thread event_del() waits for a running callback to
+	 * return. From the loop thread the callback may be the caller itself,
+	 * so destroy the watch on the loop once it is done either way.
+	 */
+	event_del(watch->event);
+	callLater([watch = std::move(watch)]() {});
+
+	return true;
+}
+
+void EventLoop::watchTriggered(int fd, short event, void *arg)
+{
+	Watch *watch = static_cast<Watch *>(arg);
+	unsigned int events = 0;
+
+	if (event & EV_READ)
+		events |= Readable;
+	if (event & EV_WRITE)
+		events |= Writable;
+
+	watch->callback(fd, events);
+}
+
+EventLoop::Watch::~Watch()
+{
+	if (event)
+		event_free(event);
+}
 
-	tv.tv_sec = sec;
-	tv.tv_usec = 0;
-	ev = evtimer_new(event_, &timeoutTriggered, this);
-	evtimer_add(ev, &tv);
+EventLoop::Lane::Lane()
+	: overflowing(false)
+{
 }
 
-void EventLoop::callLater(const std::function<void()> &func)
+void EventLoop::Lane::push(Task &&task)
 {
+	if (!overflowing.load(std::memory_order_acquire) &&
+	    calls.push(std::move(task)))
+		return;
+
+	std::unique_lock<std::mutex> locker(lock);
+	overflowing.store(true, std::memory_order_release);
+	overflow.push_back(std::move(task));
+}
+
+/*
+ * Calls spilled to the overflow list were posted after everything in the
+ * queue at the time, and before anything queued since the list was taken.
+ * A cell claimed but not yet published stops the queue short of drained:
+ * the list waits for it, its producer wakes the loop up once it is done.
+ */
+bool EventLoop::Lane::pop(Task &task)
+{
+	if (!spilled.empty()) {
+		task = std::move(spilled.front());
+		spilled.pop_front();
+		return true;
+	}
+
+	if (calls.pop(task))
+		return true;
+
+	if (!overflowing.load(std::memory_order_acquire) || !calls.drained())
+		return false;
+
 	{
-		std::unique_lock<std::mutex> locker(lock_);
-		calls_.push_back(func);
+		std::unique_lock<std::mutex> locker(lock);
+		spilled.swap(overflow);
+		overflowing.store(false, std::memory_order_release);
 	}
 
+	return pop(task);
+}
+
+void EventLoop::Lane::clear()
+{
+	Task call;
+	while (pop(call))
+		call = nullptr;
+}
+
+/*
+ * Calls that fit in a Task's inline storage are posted without allocating
+ * anything, as long as the queue doesn't overflow.
+ */
+void EventLoop::callLater(Task &&task, Priority priority)
+{
+	if (priority == Priority::Bulk)
+		bulk_.push(std::move(task));
+	else
+		control_.push(std::move(task));
+
 	interrupt();
 }
 
+/*
+ * Run the calls queued so far. Calls posted while a batch runs are left for
+ * the next one, so a busy producer can't keep the loop from getting back to
+ * its events: control calls run up to a queue's worth at a time, bulk calls
+ * only kBulkBatch at a time, with the control lane emptied before each one.
+ */
 void EventLoop::dispatchCalls()
 {
-	std::unique_lock<std::mutex> locker(lock_);
+	wakeupPending_.exchange(false, std::memory_order_acq_rel);
 
-	for (auto iter = calls_.begin(); iter != calls_.end(); ) {
-		std::function<void()> call = std::move(*iter);
+	if (!dispatchControl())
+		return;
 
-		iter = calls_.erase(iter);
+	Task call;
+	for (unsigned int count = kBulkBatch; count; --count) {
+		if (!bulk_.pop(call))
+			return;
 
-		locker.unlock();
 		call();
-		locker.lock();
+		call = nullptr;
+
+		if (!dispatchControl())
+			return;
 	}
+
+	interrupt();
+}
+
+/* Return true if the control lane was emptied. */
+bool EventLoop::dispatchControl()
+{
+	size_t count = control_.calls.capacity();
+	Task call;
+
+	while (control_.pop(call)) {
+		call();
+		call = nullptr;
+
+		if (!--count) {
+			interrupt();
+			return false;
+		}
+	}
+
+	return true;
 }
@@ -8,10 +8,20 @@
 #define __SIMPLE_CAM_EVENT_LOOP_H__
 
 #include <atomic>
+#include <chrono>
 #include <functional>
 #include <list>
+#include <memory>
 #include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
+#include "mpsc_queue.h"
+#include "task.h"
+
+struct event;
 struct event_base;
 
 class EventLoop
@@ -24,22 +34,154 @@ public:
 	int exec();
 
 	void timeout(unsigned int sec);
-	void callLater(const std::function<void()> &func);
+
+	/*
+	 * Calls run in order within a lane. Control calls always run first,
+	 * and between any two bulk calls; bulk calls run at most
+	 * kBulkBatch at a time before the loop gets back to its events.
+	 */
+	enum class Priority {
+		Control,
+		Bulk,
+	};
+
+	static constexpr unsigned int kBulkBatch = 16;
+
+	void callLater(Task &&task, Priority priority = Priority::Control);
+
+	/*
+	 * Timers run their callback on the loop thread, once or every
+	 * interval until cancelled. They can be added and cancelled from any
+	 * thread; from the loop thread cancelTimer() guarantees the callback
+	 * won't run again. Timer ids are never reused, so cancelling a timer
+	 * that has already expired is harmless.
+	 */
+	using TimerId = uint64_t;
+
+	TimerId addTimer(std::chrono::microseconds delay, Task &&callback);
+	TimerId addPeriodicTimer(std::chrono::microseconds interval, Task &&callback);
+	bool cancelTimer(TimerId id);
+
+	/*
+	 * File descriptor watches call their callback on the loop thread each
+	 * time the fd becomes readable or writable, until unwatched. The fd
+	 * stays owned by the caller and must stay open while watched.
+	 * unwatchFd() may be called from any thread, including from within
+	 * the callback itself. watchFd() returns 0 if the watch can't be set
+	 * up.
+	 */
+	enum FdEvent {
+		Readable = 1 << 0,
+		Writable = 1 << 1,
+	};
+
+	using WatchId = uint64_t;
+	using FdCallback = std::function<void(int fd, unsigned int events)>;
+
+	WatchId watchFd(int fd, unsigned int events, FdCallback callback);
+	bool unwatchFd(WatchId id);
+
+	bool isLoopThread() const;
+
+	/*
+	 * Wakeups actually sent to the loop, and those skipped because one was
+	 * already pending.
+	 */
+	uint64_t wakeups() const { return wakeups_.load(std::memory_order_relaxed); }
+	uint64_t wakeupsAvoided() const { return wakeupsAvoided_.load(std::memory_order_relaxed); }
 
 private:
-	static EventLoop *instance_;
+	static void initialize();
 
-	static void timeoutTriggered(int fd, short event, void *arg);
+	static void wakeupTriggered(int fd, short event, void *arg);
+	static void timerTriggered(int fd, short event, void *arg);
+	static void watchTriggered(int fd, short event, void *arg);
+
+	/*
+	 * Timers live in slots that keep their libevent event for reuse. The
+	 * slot table is shared with other threads under timerLock_, while the
+	 * events are only ever touched from the loop thread.
+	 */
+	struct Timer {
+		enum class State {
+			Free,
+			Pending,
+			Armed,
+			Running,
+			Cancelled,
+		};
+
+		EventLoop *loop;
+		struct event *event;
+		unsigned int index;
+		uint32_t generation;
+		State state;
+		bool periodic;
+		std::chrono::microseconds interval;
+		Task callback;
+	};
+
+	TimerId addTimer(std::chrono::microseconds interval, Task &&callback,
+			 bool periodic);
+	void armTimer(Timer *timer);
+	void disarmTimer(Timer *timer);
+	void fireTimer(Timer *timer);
+	Task freeTimer(Timer *timer);
+
+	struct Watch {
+		~Watch();
+
+		struct event *event;
+		FdCallback callback;
+	};
 
 	struct event_base *event_;
+	struct event *wakeup_;
+	std::atomic<bool> wakeupPending_;
+	std::atomic<uint64_t> wakeups_;
+	std::atomic<uint64_t> wakeupsAvoided_;
 	std::atomic<bool> exit_;
 	int exitCode_;
 
-	std::list<std::function<void()>> calls_;
-	std::mutex lock_;
+	/*
+	 * Calls are posted to a lock-free queue. Should it fill up, they spill
+	 * over to a locked list, and keep going there until the loop has taken
+	 * the list. The list is only taken once every cell claimed in the queue
+	 * has been run, including those whose producer was still filling them
+	 * in when the queue filled up, so that calls from one thread still run
+	 * in order.
+	 */
+	struct Lane {
+		Lane();
+
+		void push(Task &&task);
+		bool pop(Task &task);
+		void clear();
+
+		MpscQueue<Task> calls;
+		std::list<Task> overflow;
+		std::atomic<bool> overflowing;
+		std::mutex lock;
+
+		/* Taken from the overflow list, only touched by the loop. */
+		std::list<Task> spilled;
+	};
+
+	Lane control_;
+	Lane bulk_;
+
+	std::unordered_map<WatchId, std::unique_ptr<Watch>> watches_;
+	WatchId nextWatch_;
+	std::mutex watchLock_;
+
+	std::vector<std::unique_ptr<Timer>> timers_;
+	std::vector<unsigned int> freeTimers_;
+	std::mutex timerLock_;
+	std::atomic<std::thread::id> thread_;
 
 	void interrupt();
 	void dispatchCalls();
+	bool dispatchControl();
 };
 
 #endif /* __SIMPLE_CAM_EVENT_LOOP_H__ */
@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * frame.cpp - Reference counted handle on a completed frame
+ */
+
+#include "frame.h"
+
+#include <assert.h>
+
+using namespace libcamera;
+
+FrameSlot::FrameSlot(Request *request, FrameBuffer *buffer, ImageView view,
+		     Recycler recycler, const MappedFrameBuffer *mapping)
+	: refs_(0), releasing_(0), stage_(FrameStage::Idle), cancelled_(false),
+	  request_(request), buffer_(buffer), view_(std::move(view)),
+	  recycler_(std::move(recycler)), mapping_(mapping)
+{
+}
+
+void FrameSlot::begin()
+{
+	stage_.store(FrameStage::Queued, std::memory_order_relaxed);
+	cancelled_.store(false, std::memory_order_release);
+}
+
+/*
+ * Stop recycling the buffer, for a slot whose owner is going away: once this
+ * returns, the recycler is not running and won't be called again. Returns
+ * true if Frames still reference the slot, or are still releasing it, in
+ * which case it must be left alive for them.
+ */
+bool FrameSlot::detach()
+{
+	std::unique_lock<std::mutex> locker(recycleLock_);
+	recycler_ = nullptr;
+
+	/*
+	 * A release is counted before its reference is dropped, so seeing no
+	 * reference left means seeing the release too, until it is done.
+	 */
+	return refs_.load(std::memory_order_acquire) != 0 ||
+	       releasing_.load(std::memory_order_acquire) != 0;
+}
+
+/*
+ * Deliver a new frame in \a slot, taking its first reference. The slot must
+ * not be referenced by any other Frame.
+ */
+Frame::Frame(FrameSlot *slot, const FrameMetadata &metadata)
+	: slot_(slot)
+{
+	assert(!slot->busy());
+
+	slot->metadata_ = metadata;
+	if (slot->mapping_)
+		slot->access_ = slot->mapping_->beginCpuAccess(MappedFrameBuffer::MapFlag::Read);
+	slot->refs_.store(1, std::memory_order_release);
+}
+
+Frame::~Frame()
+{
+	release();
+}
+
+Frame::Frame(Frame &&other) noexcept
+	: slot_(other.slot_)
+{
+	other.slot_ = nullptr;
+}
+
+Frame &Frame::operator=(Frame &&other) noexcept
+{
+	if (this != &other) {
+		release();
+		slot_ = other.slot_;
+		other.slot_ = nullptr;
+	}
+
+	return *this;
+}
+
+/* Take another reference on the frame, e.g. to hand it to another thread. */
+Frame Frame::share() const
+{
+	if (!slot_)
+		return Frame();
+
+	slot_->refs_.fetch_add(1, std::memory_order_relaxed);
+	return Frame(slot_);
+}
+
+/* Drop this reference, recycling the buffer if it was the last one. */
+void Frame::release()
+{
+	FrameSlot *slot = slot_;
+	if (!slot)
+		return;
+
+	slot_ = nullptr;
+	slot->releasing_.fetch_add(1, std::memory_order_relaxed);
+
+	if (slot->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		std::unique_lock<std::mutex> locker(slot->recycleLock_);
+		slot->setStage(FrameStage::Idle);
+		slot->access_.end();
+		if (slot->recycler_)
+			slot->recycler_(slot->request_, slot->buffer_);
+	}
+
+	/* The slot may be gone as soon as this is seen by detach(). */
+	slot->releasing_.fetch_sub(1, std::memory_order_release);
+}
@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * frame.h - Reference counted handle on a completed frame
+ */
+#ifndef __SIMPLE_CAM_FRAME_H__
+#define __SIMPLE_CAM_FRAME_H__
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+#include <libcamera/framebuffer.h>
+#include <libcamera/request.h>
+
+#include "image_view.h"
+#include "mapped_framebuffer.h"
+
+class Frame;
+
+/* Where a frame is in the pipeline, as reported by deadline overruns. */
+enum class FrameStage {
+	Idle,
+	Queued,
+	Processing,
+	Held,
+};
+
+/*
+ * The state behind every Frame of one buffer. A slot is created once per
+ * buffer (and Request) when capture is set up, with the view of the mapped
+ * buffer already built, and reused for each frame delivered into that
+ * buffer, so handing out a Frame allocates nothing.
+ *
+ * When the last Frame referencing the slot goes away the recycler is called,
+ * from whichever thread dropped it, to give the buffer back to its source.
+ * Slots must outlive all of their Frames: a slot still referenced when its
+ * owner goes away must be detached and left behind.
+ */
+class FrameSlot
+{
+public:
+	using Recycler = std::function<void(libcamera::Request *request,
+					    libcamera::FrameBuffer *buffer)>;
+
+	/*
+	 * With a \a mapping, the CPU has read access to the buffer from the
+	 * delivery of a frame until its last reference is released.
+	 */
+	FrameSlot(libcamera::Request *request, libcamera::FrameBuffer *buffer,
+		  ImageView view, Recycler recycler,
+		  const libcamera::MappedFrameBuffer *mapping = nullptr);
+
+	bool busy() const { return refs_.load(std::memory_order_acquire) != 0; }
+
+	/*
+	 * The stage and cancellation flag are reset with begin() when the
+	 * buffer completes, and outlive the Frames to describe what happened
+	 * to the last one.
+	 */
+	void begin();
+	FrameStage stage() const { return stage_.load(std::memory_order_relaxed); }
+	void setStage(FrameStage stage) { stage_.store(stage, std::memory_order_relaxed); }
+	void cancel() { cancelled_.store(true, std::memory_order_release); }
+	bool cancelled() const { return cancelled_.load(std::memory_order_acquire); }
+
+	bool detach();
+
+private:
+	friend class Frame;
+
+	std::atomic<unsigned int> refs_;
+	/* Frames in release(), counted before they drop their reference. */
+	std::atomic<unsigned int> releasing_;
+	std::atomic<FrameStage> stage_;
+	std::atomic<bool> cancelled_;
+	libcamera::Request *request_;
+	libcamera::FrameBuffer *buffer_;
+	libcamera::FrameMetadata metadata_;
+	ImageView view_;
+	/* Held while the last release runs, so detach() can wait it out. */
+	std::mutex recycleLock_;
+	Recycler recycler_;
+	const libcamera::MappedFrameBuffer *mapping_;
+	libcamera::MappedFrameBuffer::CpuAccess access_;
+};
+
+/*
+ * A move-only handle on a completed frame: its Request (if it came from a
+ * camera), buffer, metadata and zero-copy plane views. Additional references
+ * are taken explicitly with share(), and the buffer goes back to the camera
+ * when the last one is released or destroyed.
+ */
+class Frame
+{
+public:
+	Frame()
+		: slot_(nullptr)
+	{
+	}
+
+	Frame(FrameSlot *slot, const libcamera::FrameMetadata &metadata);
+	~Frame();
+
+	Frame(Frame &&other) noexcept;
+	Frame &operator=(Frame &&other) noexcept;
+
+	Frame(const Frame &) = delete;
+	Frame &operator=(const Frame &) = delete;
+
+	Frame share() const;
+	void release();
+
+	explicit operator bool() const { return slot_ != nullptr; }
+
+	libcamera::Request *request() const { return slot_->request_; }
+	libcamera::FrameBuffer *buffer() const { return slot_->buffer_; }
+	const libcamera::FrameMetadata &metadata() const { return slot_->metadata_; }
+	const ImageView &view() const { return slot_->view_; }
+
+	FrameSlot *slot() const { return slot_; }
+	void setStage(FrameStage stage) const { slot_->setStage(stage); }
+
+	/*
+	 * Set when the frame overran its hard deadline and should be dropped
+	 * as soon as possible to give the buffer back to the camera.
+	 */
+	bool cancelled() const { return slot_->cancelled(); }
+
+private:
+	explicit Frame(FrameSlot *slot)
+		: slot_(slot)
+	{
+	}
+
+	FrameSlot *slot_;
+};
+
+#endif /* __SIMPLE_CAM_FRAME_H__ */
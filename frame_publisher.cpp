@@ -0,0 +1,297 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * frame_publisher.cpp - Share completed frames with other processes
+ */
+
+#include "frame_publisher.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <limits.h>
+#include <linux/futex.h>
+#include <new>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+using namespace libcamera;
+
+FramePublisher::FramePublisher(const std::string &path)
+	: path_(path), loop_(nullptr), watch_(0), socket_(-1), memfd_(-1),
+	  header_(nullptr), budget_(nullptr), subscribers_(0)
+{
+}
+
+FramePublisher::~FramePublisher()
+{
+	stop();
+}
+
+/*
+ * Share \a buffers, the capture buffers of a stream configured as \a cfg,
+ * and start accepting subscribers from \a loop. The buffers must stay
+ * allocated until stop().
+ */
+int FramePublisher::start(EventLoop &loop, const StreamConfiguration &cfg,
+			  const std::vector<FrameBuffer *> &buffers)
+{
+	using namespace SharedFrameRing;
+
+	if (header_)
+		return -EBUSY;
+
+	if (buffers.empty() || buffers.size() > kMaxSlots) {
+		std::cerr << "Can't publish " << buffers.size() << " buffers" << std::endl;
+		return -EINVAL;
+	}
+
+	unsigned int planeCount = buffers[0]->planes().size();
+	for (const FrameBuffer *buffer : buffers) {
+		if (buffer->planes().size() != planeCount || planeCount > kMaxPlanes) {
+			std::cerr << "Can't publish buffers of "
+				  << buffer->planes().size() << " planes" << std::endl;
+			return -EINVAL;
+		}
+	}
+
+	memfd_ = memfd_create("simple-cam-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (memfd_ < 0 || ftruncate(memfd_, sizeof(Header)) < 0) {
+		int ret = -errno;
+		std::cerr << "Can't create the ring: " << strerror(-ret) << std::endl;
+		stop();
+		return ret;
+	}
+
+	void *address = mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE,
+			     MAP_SHARED, memfd_, 0);
+	if (address == MAP_FAILED) {
+		int ret = -errno;
+		std::cerr << "Can't map the ring: " << strerror(-ret) << std::endl;
+		stop();
+		return ret;
+	}
+
+	/*
+	 * Only the mapping made above stays writable. Kernels older than 5.1
+	 * can't seal future writes, subscribers are trusted not to write there.
+	 */
+	if (fcntl(memfd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE) < 0)
+		fcntl(memfd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW);
+
+	header_ = new (address) Header();
+	if (budget_)
+		budget_->charge(MemoryBudget::Category::Rings, sizeof(Header));
+	header_->magic = kMagic;
+	header_->version = kVersion;
+	header_->fourcc = cfg.pixelFormat.fourcc();
+	header_->width = cfg.size.width;
+	header_->height = cfg.size.height;
+	header_->stride = cfg.stride;
+	header_->slotCount = buffers.size();
+	header_->planeCount = planeCount;
+
+	fds_ = { memfd_ };
+	for (unsigned int i = 0; i < buffers.size(); ++i) {
+		Slot &slot = header_->slots[i];
+		slot.seq.store(1, std::memory_order_relaxed);
+
+		for (unsigned int p = 0; p < planeCount; ++p) {
+			const FrameBuffer::Plane &plane = buffers[i]->planes()[p];
+			slot.planes[p] = { plane.offset, plane.length };
+			fds_.push_back(plane.fd.fd());
+		}
+	}
+
+	buffers_.assign(buffers.begin(), buffers.end());
+
+	socket_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (socket_ < 0) {
+		int ret = -errno;
+		stop();
+		return ret;
+	}
+
+	struct sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	if (path_.size() >= sizeof(addr.sun_path)) {
+		stop();
+		return -ENAMETOOLONG;
+	}
+	strcpy(addr.sun_path, path_.c_str());
+
+	/* A socket left behind by a publisher that died would be in the way. */
+	unlink(path_.c_str());
+
+	if (bind(socket_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0 ||
+	    listen(socket_, 8) < 0) {
+		int ret = -errno;
+		std::cerr << "Can't listen on " << path_ << ": " << strerror(-ret) << std::endl;
+		stop();
+		return ret;
+	}
+
+	loop_ = &loop;
+	watch_ = loop.watchFd(socket_, EventLoop::Readable,
+			      [this](int, unsigned int) { accept(); });
+
+	return 0;
+}
+
+/*
+ * Stop accepting subscribers and tell the connected ones there won't be
+ * any more frames. They keep their mappings, and the memory behind them,
+ * for as long as they want.
+ */
+void FramePublisher::stop()
+{
+	if (watch_) {
+		loop_->unwatchFd(watch_);
+		watch_ = 0;
+	}
+
+	if (socket_ >= 0) {
+		close(socket_);
+		unlink(path_.c_str());
+		socket_ = -1;
+	}
+
+	latest_.release();
+
+	if (header_) {
+		for (unsigned int i = 0; i < buffers_.size(); ++i)
+			retire(i);
+
+		header_->closed.store(1, std::memory_order_relaxed);
+		header_->published.fetch_add(1, std::memory_order_release);
+		syscall(SYS_futex, &header_->published, FUTEX_WAKE, INT_MAX,
+			nullptr, nullptr, 0);
+
+		munmap(header_, sizeof(*header_));
+		header_ = nullptr;
+
+		if (budget_)
+			budget_->release(MemoryBudget::Category::Rings,
+					 sizeof(SharedFrameRing::Header));
+	}
+
+	if (memfd_ >= 0) {
+		close(memfd_);
+		memfd_ = -1;
+	}
+
+	buffers_.clear();
+	fds_.clear();
+}
+
+/*
+ * Make \a frame readable, as the latest one, and hold it until the next one.
+ * Frames are published before anything in this process gets to see them.
+ */
+void FramePublisher::publish(const Frame &frame)
+{
+	if (!header_)
+		return;
+
+	const FrameMetadata &metadata = frame.metadata();
+	auto it = std::find(buffers_.begin(), buffers_.end(), frame.buffer());
+	if (it == buffers_.end())
+		return;
+
+	unsigned int index = it - buffers_.begin();
+	SharedFrameRing::Slot &slot = header_->slots[index];
+
+	uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+	if (!(seq & 1)) {
+		slot.seq.store(++seq, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	slot.sequence = metadata.sequence;
+	slot.timestamp = metadata.timestamp;
+	slot.seq.store(seq + 1, std::memory_order_release);
+
+	header_->latest.store(index, std::memory_order_release);
+	header_->published.fetch_add(1, std::memory_order_release);
+
+	if (subscribers_.load(std::memory_order_relaxed))
+		syscall(SYS_futex, &header_->published, FUTEX_WAKE, INT_MAX,
+			nullptr, nullptr, 0);
+
+	/* Dropping the previous frame retires it, if nothing else holds it. */
+	latest_ = frame.share();
+}
+
+/* Let go of the latest frame, e.g. to let the camera drain. */
+void FramePublisher::release()
+{
+	latest_.release();
+}
+
+/*
+ * Take buffer \a index back from the readers, before it is given back to
+ * the camera to be written over.
+ */
+void FramePublisher::retire(unsigned int index)
+{
+	if (!header_ || index >= buffers_.size())
+		return;
+
+	SharedFrameRing::Slot &slot = header_->slots[index];
+	uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+	if (!(seq & 1))
+		slot.seq.store(seq + 1, std::memory_order_seq_cst);
+}
+
+void FramePublisher::accept()
+{
+	while (true) {
+		int subscriber = accept4(socket_, nullptr, nullptr, SOCK_CLOEXEC);
+		if (subscriber < 0)
+			return;
+
+		if (send(subscriber) < 0)
+			std::cerr << "Can't send frames to a subscriber" << std::endl;
+		else
+			subscribers_.fetch_add(1, std::memory_order_relaxed);
+
+		close(subscriber);
+	}
+}
+
+/* Send the ring fds to a newly connected subscriber. */
+int FramePublisher::send(int subscriber)
+{
+	uint32_t hello[2] = { SharedFrameRing::kMagic, SharedFrameRing::kVersion };
+	struct iovec iov = { hello, sizeof(hello) };
+
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * SharedFrameRing::kMaxFds)];
+		struct cmsghdr align;
+	} control = {};
+
+	struct msghdr msg = {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds_.size());
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds_.size());
+	memcpy(CMSG_DATA(cmsg), fds_.data(), sizeof(int) * fds_.size());
+
+	if (sendmsg(subscriber, &msg, MSG_NOSIGNAL) < 0)
+		return -errno;
+
+	return 0;
+}
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * frame_publisher.h - Share completed frames with other processes
+ */
+#ifndef __SIMPLE_CAM_FRAME_PUBLISHER_H__
+#define __SIMPLE_CAM_FRAME_PUBLISHER_H__
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <libcamera/framebuffer.h>
+#include <libcamera/stream.h>
+
+#include "event_loop.h"
+#include "frame.h"
+#include "memory_budget.h"
+#include "shared_frame_ring.h"
+
+/*
+ * Publishes completed frames to any number of FrameSubscribers in other
+ * processes, without copying them: see SharedFrameRing. Subscribers connect
+ * to a unix socket at \a path, and receive the fds of the control block and
+ * of the capture buffers over it.
+ *
+ * The latest published frame is held until the next one is published, so
+ * that its buffer isn't retired and given back to the camera under the
+ * subscribers as soon as this process is done with it. That keeps one buffer
+ * away from the camera while publishing.
+ *
+ * publish() and release() must run on the EventLoop thread, retire() may run
+ * on any thread, but never concurrently with publish() for the same buffer.
+ */
+class FramePublisher
+{
+public:
+	explicit FramePublisher(const std::string &path);
+	~FramePublisher();
+
+	int start(EventLoop &loop, const libcamera::StreamConfiguration &cfg,
+		  const std::vector<libcamera::FrameBuffer *> &buffers);
+	void stop();
+
+	void setBudget(MemoryBudget *budget) { budget_ = budget; }
+
+	void publish(const Frame &frame);
+	void release();
+	void retire(unsigned int index);
+
+	const std::string &path() const { return path_; }
+	unsigned int subscribers() const { return subscribers_.load(std::memory_order_relaxed); }
+
+private:
+	void accept();
+	int send(int socket);
+
+	const std::string path_;
+	EventLoop *loop_;
+	EventLoop::WatchId watch_;
+	int socket_;
+	int memfd_;
+	SharedFrameRing::Header *header_;
+	MemoryBudget *budget_;
+	std::vector<const libcamera::FrameBuffer *> buffers_;
+	std::vector<int> fds_;
+	std::atomic<unsigned int> subscribers_;
+	Frame latest_;
+};
+
+#endif /* __SIMPLE_CAM_FRAME_PUBLISHER_H__ */
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * frame_stats.cpp - Frame drop and sequence gap accounting
+ */
+
+#include "frame_stats.h"
+
+#include <sstream>
+
+using namespace libcamera;
+
+FrameStats::FrameStats()
+{
+	reset();
+}
+
+/*
+ * Account for a buffer completed by the camera. \a requestsQueued is the
+ * number of Requests still queued in the camera once this one completed.
+ */
+void FrameStats::completed(const FrameMetadata &metadata,
+			   unsigned int requestsQueued)
+{
+	switch (metadata.status) {
+	case FrameMetadata::FrameSuccess:
+		break;
+	case FrameMetadata::FrameError:
+		dropped(Drop::FrameError);
+		break;
+	case FrameMetadata::FrameCancelled:
+		/* Cancelled buffers carry no valid sequence number. */
+		dropped(Drop::FrameCancelled);
+		return;
+	}
+
+	if (haveSequence_ && metadata.sequence > lastSequence_ + 1) {
+		unsigned int missing = metadata.sequence - lastSequence_ - 1;
+		dropped(starved_ ? Drop::NoFreeRequest : Drop::SequenceGap, missing);
+	}
+
+	haveSequence_ = true;
+	lastSequence_ = metadata.sequence;
+	starved_ = requestsQueued == 0;
+
+	if (metadata.status == FrameMetadata::FrameSuccess)
+		frames_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FrameStats::dropped(Drop cause, uint64_t count)
+{
+	drops_[static_cast<unsigned int>(cause)].fetch_add(count, std::memory_order_relaxed);
+}
+
+void FrameStats::reset()
+{
+	frames_.store(0, std::memory_order_relaxed);
+	for (std::atomic<uint64_t> &count : drops_)
+		count.store(0, std::memory_order_relaxed);
+
+	haveSequence_ = false;
+	lastSequence_ = 0;
+	starved_ = false;
+}
+
+uint64_t FrameStats::drops(Drop cause) const
+{
+	return drops_[static_cast<unsigned int>(cause)].load(std::memory_order_relaxed);
+}
+
+uint64_t FrameStats::sensorDrops() const
+{
+	return drops(Drop::SequenceGap) + drops(Drop::FrameError);
+}
+
+uint64_t FrameStats::applicationDrops() const
+{
+	return drops(Drop::NoFreeRequest) + drops(Drop::SlowConsumer) +
+	       drops(Drop::WriterOverflow) + drops(Drop::OverBudget);
+}
+
+std::string FrameStats::toString() const
+{
+	std::stringstream ss;
+
+	ss << "frames " << frames()
+	   << " sensor drops " << sensorDrops()
+	   << " (gap " << drops(Drop::SequenceGap)
+	   << ", error " << drops(Drop::FrameError) << ")"
+	   << " application drops " << applicationDrops()
+	   << " (no request " << drops(Drop::NoFreeRequest)
+	   << ", slow consumer " << drops(Drop::SlowConsumer)
+	   << ", writer overflow " << drops(Drop::WriterOverflow)
+	   << ", over budget " << drops(Drop::OverBudget) << ")"
+	   << " cancelled " << cancelledDrops();
+
+	return ss.str();
+}
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * frame_stats.h - Frame drop and sequence gap accounting
+ */
+#ifndef __SIMPLE_CAM_FRAME_STATS_H__
+#define __SIMPLE_CAM_FRAME_STATS_H__
+
+#include <array>
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+#include <libcamera/framebuffer.h>
+
+/*
+ * Counts completed and dropped frames of one stream, split by where and why
+ * they were lost.
+ *
+ * Sensor side drops are derived from the FrameMetadata of completed buffers:
+ * gaps in the sequence number and buffers completed with an error. A gap
+ * that follows a completion which left no Request queued in the camera is
+ * charged to the application instead (NoFreeRequest), as the sensor had
+ * nowhere to put those frames.
+ *
+ * Application side drops are reported explicitly with dropped().
+ *
+ * Cancelled buffers are counted on their own. They are the Requests still
+ * queued when Camera::stop() runs, and belong to neither side.
+ *
+ * completed() must always be called from the same thread, the counters can
+ * be read from anywhere.
+ */
+class FrameStats
+{
+public:
+	enum class Drop {
+		/* Sensor side */
+		SequenceGap,
+		FrameError,
+		/* Neither side, see cancelledDrops() */
+		FrameCancelled,
+		/* Application side */
+		NoFreeRequest,
+		SlowConsumer,
+		WriterOverflow,
+		OverBudget,
+	};
+
+	static constexpr unsigned int kNumDrops = 7;
+
+	FrameStats();
+
+	void completed(const libcamera::FrameMetadata &metadata,
+		       unsigned int requestsQueued);
+	void dropped(Drop cause, uint64_t count = 1);
+	void reset();
+
+	uint64_t frames() const { return frames_.load(std::memory_order_relaxed); }
+	uint64_t drops(Drop cause) const;
+	uint64_t sensorDrops() const;
+	uint64_t applicationDrops() const;
+	uint64_t cancelledDrops() const { return drops(Drop::FrameCancelled); }
+
+	std::string toString() const;
+
+private:
+	std::atomic<uint64_t> frames_;
+	std::array<std::atomic<uint64_t>, kNumDrops> drops_;
+
+	bool haveSequence_;
+	unsigned int lastSequence_;
+	bool starved_;
+};
+
+#endif /* __SIMPLE_CAM_FRAME_STATS_H__ */
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * frame_stream.cpp - Awaitable stream of completed frames
+ */
+
+#include "frame_stream.h"
+
+#ifdef SIMPLE_CAM_COROUTINES
+
+void FrameStream::Awaiter::await_suspend(std::coroutine_handle<> handle)
+{
+	handle_ = handle;
+	stream_->waiters_.push_back(this);
+}
+
+void FrameStream::publish(const Frame &frame)
+{
+	resume(&frame);
+}
+
+/* Wake up every waiting coroutine with an empty Frame. */
+void FrameStream::close()
+{
+	closed_ = true;
+	resume(nullptr);
+}
+
+/*
+ * Coroutines resumed here may await next() again straight away: they then
+ * wait for the following frame, as the waiters have been swapped out. The
+ * spare vector keeps the swap free of allocations in the steady state.
+ */
+void FrameStream::resume(const Frame *frame)
+{
+	if (waiters_.empty())
+		return;
+
+	std::vector<Awaiter *> waiters;
+	waiters.swap(resuming_);
+	waiters.swap(waiters_);
+
+	for (Awaiter *waiter : waiters) {
+		if (frame)
+			waiter->frame_ = frame->share();
+		waiter->handle_.resume();
+	}
+
+	waiters.clear();
+	if (resuming_.capacity() < waiters.capacity())
+		resuming_.swap(waiters);
+}
+
+#endif /* SIMPLE_CAM_COROUTINES */
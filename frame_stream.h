@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * frame_stream.h - Awaitable stream of completed frames
+ */
+#ifndef __SIMPLE_CAM_FRAME_STREAM_H__
+#define __SIMPLE_CAM_FRAME_STREAM_H__
+
+#ifdef SIMPLE_CAM_COROUTINES
+
+#if !defined(__cpp_impl_coroutine)
+#error "SIMPLE_CAM_COROUTINES needs a C++20 compiler with coroutine support"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <vector>
+
+#include "frame.h"
+
+/*
+ * Hands each published frame to every coroutine suspended on next(). A
+ * coroutine awaiting next() resumes on the EventLoop thread, from within
+ * publish(), with its own reference on the frame: the buffer stays away
+ * from the camera until the coroutine drops it, even across later
+ * suspensions. Once closed, next() completes at once with an empty Frame.
+ *
+ * Not thread safe: the stream must only be used from the EventLoop thread,
+ * so coroutines awaiting it must be started there too.
+ */
+class FrameStream
+{
+public:
+	class Awaiter
+	{
+	public:
+		bool await_ready() const noexcept { return stream_->closed_; }
+		void await_suspend(std::coroutine_handle<> handle);
+		Frame await_resume() noexcept { return std::move(frame_); }
+
+	private:
+		friend class FrameStream;
+
+		explicit Awaiter(FrameStream *stream)
+			: stream_(stream)
+		{
+		}
+
+		FrameStream *stream_;
+		std::coroutine_handle<> handle_;
+		Frame frame_;
+	};
+
+	FrameStream()
+		: closed_(false)
+	{
+	}
+
+	Awaiter next() { return Awaiter(this); }
+
+	void publish(const Frame &frame);
+	void close();
+	void reopen() { closed_ = false; }
+
+	bool closed() const { return closed_; }
+	bool waiting() const { return !waiters_.empty(); }
+
+private:
+	void resume(const Frame *frame);
+
+	std::vector<Awaiter *> waiters_;
+	std::vector<Awaiter *> resuming_;
+	bool closed_;
+};
+
+/*
+ * Return type of a coroutine that runs on its own once called, and frees
+ * itself when it completes. Exceptions escaping it terminate the program.
+ */
+struct FrameCoroutine {
+	struct promise_type {
+		FrameCoroutine get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+#endif /* SIMPLE_CAM_COROUTINES */
+
+#endif /* __SIMPLE_CAM_FRAME_STREAM_H__ */
@@ -0,0 +1,267 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * frame_subscriber.cpp - Read frames published by another process
+ */
+
+#include "frame_subscriber.h"
+
+#include <errno.h>
+#include <iostream>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace libcamera;
+
+FrameSubscriber::FrameSubscriber()
+	: header_(nullptr), seen_(0)
+{
+}
+
+FrameSubscriber::~FrameSubscriber()
+{
+	disconnect();
+}
+
+/* Connect to the publisher listening at \a path and map its frames. */
+int FrameSubscriber::connect(const std::string &path)
+{
+	using namespace SharedFrameRing;
+
+	disconnect();
+
+	int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -errno;
+
+	struct sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		close(sock);
+		return -ENAMETOOLONG;
+	}
+	strcpy(addr.sun_path, path.c_str());
+
+	std::vector<int> fds;
+	int ret = 0;
+	if (::connect(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0)
+		ret = -errno;
+	else
+		ret = receive(sock, fds);
+	close(sock);
+
+	if (ret < 0)
+		return ret;
+
+	void *address = mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED,
+			     fds[0], 0);
+	close(fds[0]);
+	if (address == MAP_FAILED) {
+		ret = -errno;
+		for (unsigned int i = 1; i < fds.size(); ++i)
+			close(fds[i]);
+		return ret;
+	}
+
+	header_ = static_cast<const Header *>(address);
+	if (header_->magic != kMagic || header_->version != kVersion ||
+	    header_->slotCount > kMaxSlots || header_->planeCount > kMaxPlanes ||
+	    fds.size() != 1 + header_->slotCount * header_->planeCount) {
+		std::cerr << "Unexpected frame ring layout from " << path << std::endl;
+		for (unsigned int i = 1; i < fds.size(); ++i)
+			close(fds[i]);
+		disconnect();
+		return -EPROTO;
+	}
+
+	format_ = PixelFormat(header_->fourcc);
+	size_ = Size(header_->width, header_->height);
+
+	/*
+	 * Planes sharing a buffer arrive as separate fds. Find them out, so
+	 * that each buffer is mapped only once.
+	 */
+	unsigned int next = 1;
+	for (unsigned int i = 0; i < header_->slotCount; ++i) {
+		std::vector<FrameBuffer::Plane> planes;
+		struct stat last = {};
+
+		for (unsigned int p = 0; p < header_->planeCount; ++p) {
+			int fd = fds[next++];
+			struct stat st = {};
+			fstat(fd, &st);
+
+			FrameBuffer::Plane plane;
+			if (p && st.st_dev == last.st_dev && st.st_ino == last.st_ino) {
+				close(fd);
+				plane.fd = planes.back().fd;
+			} else {
+				plane.fd = FileDescriptor(std::move(fd));
+			}
+			plane.offset = header_->slots[i].planes[p].offset;
+			plane.length = header_->slots[i].planes[p].length;
+			planes.push_back(plane);
+			last = st;
+		}
+
+		buffers_.push_back(std::make_unique<FrameBuffer>(planes, i));
+	}
+
+	mappings_.reserve(buffers_.size());
+	for (const std::unique_ptr<FrameBuffer> &buffer : buffers_) {
+		mappings_.emplace_back(buffer.get(), MappedFrameBuffer::MapFlag::Read);
+		if (!mappings_.back().isValid()) {
+			ret = mappings_.back().error();
+			disconnect();
+			return ret;
+		}
+
+		views_.emplace_back(mappings_.back().planes(), format_, size_,
+				    header_->stride);
+	}
+
+	seen_ = header_->published.load(std::memory_order_acquire);
+
+	return 0;
+}
+
+void FrameSubscriber::disconnect()
+{
+	views_.clear();
+	mappings_.clear();
+	buffers_.clear();
+
+	if (header_) {
+		munmap(const_cast<SharedFrameRing::Header *>(header_),
+		       sizeof(*header_));
+		header_ = nullptr;
+	}
+}
+
+int FrameSubscriber::receive(int sock, std::vector<int> &fds)
+{
+	uint32_t hello[2] = {};
+	struct iovec iov = { hello, sizeof(hello) };
+
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * SharedFrameRing::kMaxFds)];
+		struct cmsghdr align;
+	} control = {};
+
+	struct msghdr msg = {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	ssize_t size = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	if (size < 0)
+		return -errno;
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+	     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		size_t first = fds.size();
+		fds.resize(first + count);
+		memcpy(&fds[first], CMSG_DATA(cmsg), count * sizeof(int));
+	}
+
+	if (size != sizeof(hello) || hello[0] != SharedFrameRing::kMagic ||
+	    hello[1] != SharedFrameRing::kVersion || fds.empty() ||
+	    (msg.msg_flags & MSG_CTRUNC)) {
+		for (int fd : fds)
+			close(fd);
+		fds.clear();
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+/*
+ * Wait up to \a timeout for a frame newer than the last one read. Returns
+ * false on timeout, or if the publisher has stopped.
+ */
+bool FrameSubscriber::wait(std::chrono::milliseconds timeout)
+{
+	if (!header_)
+		return false;
+
+	uint32_t published = header_->published.load(std::memory_order_acquire);
+	if (published == seen_) {
+		struct timespec ts;
+		ts.tv_sec = timeout.count() / 1000;
+		ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+
+		syscall(SYS_futex, &header_->published, FUTEX_WAIT, seen_, &ts,
+			nullptr, 0);
+		published = header_->published.load(std::memory_order_acquire);
+	}
+
+	return published != seen_ && !closed();
+}
+
+/*
+ * Read the latest frame in place. Returns false if there is none, or if
+ * the camera kept writing over the latest ones while reading them.
+ */
+bool FrameSubscriber::read(SharedFrame &frame)
+{
+	frame.access.end();
+
+	if (!header_)
+		return false;
+
+	for (unsigned int attempt = 0; attempt < 4; ++attempt) {
+		uint32_t published = header_->published.load(std::memory_order_acquire);
+		unsigned int index = header_->latest.load(std::memory_order_acquire);
+		if (index >= views_.size())
+			return false;
+
+		const SharedFrameRing::Slot &slot = header_->slots[index];
+		uint32_t seq = slot.seq.load(std::memory_order_acquire);
+		if (seq & 1)
+			continue;
+
+		/* Read access begins before the frame is known to be valid. */
+		frame.access = mappings_[index].beginCpuAccess(MappedFrameBuffer::MapFlag::Read);
+		frame.slot = index;
+		frame.seq = seq;
+		frame.sequence = slot.sequence;
+		frame.timestamp = slot.timestamp;
+		frame.view = &views_[index];
+
+		if (!valid(frame))
+			continue;
+
+		seen_ = published;
+		return true;
+	}
+
+	frame.access.end();
+	return false;
+}
+
+/* Check that \a frame hasn't been written over since it was read. */
+bool FrameSubscriber::valid(const SharedFrame &frame) const
+{
+	if (!header_ || frame.slot >= views_.size())
+		return false;
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return header_->slots[frame.slot].seq.load(std::memory_order_relaxed) == frame.seq;
+}
+
+bool FrameSubscriber::closed() const
+{
+	return !header_ || header_->closed.load(std::memory_order_acquire);
+}
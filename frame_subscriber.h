@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * frame_subscriber.h - Read frames published by another process
+ */
+#ifndef __SIMPLE_CAM_FRAME_SUBSCRIBER_H__
+#define __SIMPLE_CAM_FRAME_SUBSCRIBER_H__
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <libcamera/framebuffer.h>
+
+#include "image_view.h"
+#include "mapped_framebuffer.h"
+#include "shared_frame_ring.h"
+
+/*
+ * A frame read in place from the ring. The view points straight into the
+ * shared buffer, and stays readable for as long as the subscriber is
+ * connected, but what it shows is only the frame described here until
+ * FrameSubscriber::valid() turns false.
+ *
+ * The CPU has read access to the buffer from read() until the frame is read
+ * again or destroyed, which must happen before the subscriber disconnects.
+ */
+struct SharedFrame {
+	unsigned int slot = 0;
+	uint32_t seq = 0;
+	uint64_t sequence = 0;
+	uint64_t timestamp = 0;
+	const ImageView *view = nullptr;
+	libcamera::MappedFrameBuffer::CpuAccess access;
+};
+
+/*
+ * Connects to a FramePublisher and maps its buffers read-only. Frames are
+ * read without copying them and without taking any lock: copy out, or
+ * check valid() after processing, as the camera may write over a frame at
+ * any time once newer ones have been published.
+ */
+class FrameSubscriber
+{
+public:
+	FrameSubscriber();
+	~FrameSubscriber();
+
+	int connect(const std::string &path);
+	void disconnect();
+
+	bool wait(std::chrono::milliseconds timeout);
+	bool read(SharedFrame &frame);
+	bool valid(const SharedFrame &frame) const;
+	bool closed() const;
+
+	const libcamera::PixelFormat &format() const { return format_; }
+	const libcamera::Size &size() const { return size_; }
+
+private:
+	int receive(int socket, std::vector<int> &fds);
+
+	const SharedFrameRing::Header *header_;
+	libcamera::PixelFormat format_;
+	libcamera::Size size_;
+	uint32_t seen_;
+
+	std::vector<std::unique_ptr<libcamera::FrameBuffer>> buffers_;
+	std::vector<libcamera::MappedFrameBuffer> mappings_;
+	std::vector<ImageView> views_;
+};
+
+#endif /* __SIMPLE_CAM_FRAME_SUBSCRIBER_H__ */
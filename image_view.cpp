@@ -0,0 +1,208 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * image_view.cpp - Zero-copy cv::Mat views of mapped frame planes
+ */
+
+#include "image_view.h"
+
+#include <libcamera/formats.h>
+
+using namespace libcamera;
+
+namespace {
+
+struct PlaneLayout {
+	int type;
+	unsigned int hSub;
+	unsigned int vSub;
+	unsigned int strideDiv;
+};
+
+/* Returns the number of planes, or 0 if the format is not supported. */
+unsigned int planeLayout(const PixelFormat &format, PlaneLayout layout[3])
+{
+	if (format == formats::R8) {
+		layout[0] = { CV_8UC1, 1, 1, 1 };
+		return 1;
+	}
+
+	if (format == formats::YUV420) {
+		layout[0] = { CV_8UC1, 1, 1, 1 };
+		layout[1] = { CV_8UC1, 2, 2, 2 };
+		layout[2] = { CV_8UC1, 2, 2, 2 };
+		return 3;
+	}
+
+	if (format == formats::NV12 || format == formats::NV21) {
+		layout[0] = { CV_8UC1, 1, 1, 1 };
+		layout[1] = { CV_8UC2, 2, 2, 1 };
+		return 2;
+	}
+
+	if (format == formats::YUYV) {
+		layout[0] = { CV_8UC2, 1, 1, 1 };
+		return 1;
+	}
+
+	if (format == formats::RGB888 || format == formats::BGR888) {
+		layout[0] = { CV_8UC3, 1, 1, 1 };
+		return 1;
+	}
+
+	if (format == formats::XRGB8888) {
+		layout[0] = { CV_8UC4, 1, 1, 1 };
+		return 1;
+	}
+
+	return 0;
+}
+
+} /* namespace */
+
+ImageView::ImageView(const std::vector<Span<uint8_t>> &planes,
+		     const PixelFormat &format, const Size &size,
+		     unsigned int stride)
+	: format_(format)
+{
+	PlaneLayout layout[3];
+	unsigned int count = planeLayout(format, layout);
+	if (!count || planes.empty())
+		return;
+
+	/* Planes either map one to one, or all live in the first one. */
+	bool packed = planes.size() < count;
+	size_t offset = 0;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		const PlaneLayout &l = layout[i];
+		int rows = size.height / l.vSub;
+		int cols = size.width / l.hSub;
+		size_t step = stride / l.strideDiv;
+		size_t length = step * rows;
+
+		uint8_t *data;
+		size_t available;
+		if (packed) {
+			data = planes[0].data() + offset;
+			available = planes[0].size() > offset ? planes[0].size() - offset : 0;
+			offset += length;
+		} else {
+			data = planes[i].data();
+			available = planes[i].size();
+		}
+
+		size_t needed = step * (rows - 1) + cols * CV_ELEM_SIZE(l.type);
+		if (rows <= 0 || cols <= 0 || needed > available) {
+			planes_.clear();
+			return;
+		}
+
+		planes_.emplace_back(rows, cols, l.type, data, step);
+	}
+}
+
+bool ImageView::isSupported(const PixelFormat &format)
+{
+	PlaneLayout layout[3];
+	return planeLayout(format, layout) != 0;
+}
+
+/* Stride of the first plane for a tightly packed line, 0 if unsupported. */
+unsigned int ImageView::minimumStride(const PixelFormat &format, unsigned int width)
+{
+	PlaneLayout layout[3];
+	if (!planeLayout(format, layout))
+		return 0;
+
+	return width * CV_ELEM_SIZE(layout[0].type);
+}
+
+/* Byte size of each plane in the order ImageView expects them. */
+std::vector<size_t> ImageView::planeSizes(const PixelFormat &format,
+					  const Size &size, unsigned int stride)
+{
+	PlaneLayout layout[3];
+	unsigned int count = planeLayout(format, layout);
+
+	std::vector<size_t> sizes;
+	for (unsigned int i = 0; i < count; ++i)
+		sizes.push_back(static_cast<size_t>(stride / layout[i].strideDiv) *
+				(size.height / layout[i].vSub));
+
+	return sizes;
+}
+
+bool ImageView::toBGR(cv::Mat &dst) const
+{
+	if (!isValid())
+		return false;
+
+	/* libcamera names formats after DRM fourccs, little-endian in memory. */
+	if (format_ == formats::RGB888) {
+		dst = planes_[0];
+	} else if (format_ == formats::BGR888) {
+		cv::cvtColor(planes_[0], dst, cv::COLOR_RGB2BGR);
+	} else if (format_ == formats::XRGB8888) {
+		cv::cvtColor(planes_[0], dst, cv::COLOR_BGRA2BGR);
+	} else if (format_ == formats::YUYV) {
+		cv::cvtColor(planes_[0], dst, cv::COLOR_YUV2BGR_YUYV);
+	} else if (format_ == formats::NV12) {
+		cv::cvtColorTwoPlane(planes_[0], planes_[1], dst, cv::COLOR_YUV2BGR_NV12);
+	} else if (format_ == formats::NV21) {
+		cv::cvtColorTwoPlane(planes_[0], planes_[1], dst, cv::COLOR_YUV2BGR_NV21);
+	} else if (format_ == formats::YUV420) {
+		/*
+		 * OpenCV only takes I420 as one contiguous Mat. Wrap the frame
+		 * as such when it is laid out that way, and pack it otherwise.
+		 */
+		const cv::Mat &y = planes_[0];
+		const cv::Mat &u = planes_[1];
+		const cv::Mat &v = planes_[2];
+		int rows = y.rows + y.rows / 2;
+
+		if (y.isContinuous() && u.isContinuous() && v.isContinuous() &&
+		    u.data == y.data + y.total() &&
+		    v.data == u.data + u.total()) {
+			cv::Mat i420(rows, y.cols, CV_8UC1, y.data);
+			cv::cvtColor(i420, dst, cv::COLOR_YUV2BGR_I420);
+		} else {
+			/* The packed copy comes from the same allocator as dst. */
+			cv::Mat i420;
+			i420.allocator = dst.allocator;
+			i420.create(rows, y.cols, CV_8UC1);
+			uint8_t *data = i420.data;
+			cv::Mat yDst(y.rows, y.cols, CV_8UC1, data);
+			cv::Mat uDst(u.rows, u.cols, CV_8UC1, data += y.total());
+			cv::Mat vDst(v.rows, v.cols, CV_8UC1, data += u.total());
+			y.copyTo(yDst);
+			u.copyTo(uDst);
+			v.copyTo(vDst);
+			cv::cvtColor(i420, dst, cv::COLOR_YUV2BGR_I420);
+		}
+	} else {
+		cv::cvtColor(planes_[0], dst, cv::COLOR_GRAY2BGR);
+	}
+
+	return true;
+}
+
+bool ImageView::toGray(cv::Mat &dst) const
+{
+	if (!isValid())
+		return false;
+
+	if (format_ == formats::R8 || format_ == formats::YUV420 ||
+	    format_ == formats::NV12 || format_ == formats::NV21) {
+		dst = planes_[0];
+	} else if (format_ == formats::YUYV) {
+		cv::cvtColor(planes_[0], dst, cv::COLOR_YUV2GRAY_YUYV);
+	} else if (format_ == formats::RGB888) {
+		cv::cvtColor(planes_[0], dst, cv::COLOR_BGR2GRAY);
+	} else if (format_ == formats::BGR888) {
+		cv::cvtColor(planes_[0], dst, cv::COLOR_RGB2GRAY);
+	} else {
+		cv::cvtColor(planes_[0], dst, cv::COLOR_BGRA2GRAY);
+	}
+
+	return true;
+}
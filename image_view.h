@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * image_view.h - Zero-copy cv::Mat views of mapped frame planes
+ */
+#ifndef __SIMPLE_CAM_IMAGE_VIEW_H__
+#define __SIMPLE_CAM_IMAGE_VIEW_H__
+
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/base/span.h>
+
+#include <libcamera/geometry.h>
+#include <libcamera/pixel_format.h>
+
+#include <opencv2/opencv.hpp>
+
+/*
+ * Wraps the planes of a mapped frame in cv::Mat headers that honour the
+ * stream stride and pixel format. The headers point straight at the mapped
+ * memory and are only valid for as long as the mapping and the frame are.
+ *
+ * Supported formats and their plane layouts:
+ *
+ *   R8                 Y (CV_8UC1)
+ *   YUV420             Y (CV_8UC1), U and V (CV_8UC1, half size, half stride)
+ *   NV12, NV21         Y (CV_8UC1), interleaved chroma (CV_8UC2, half size)
+ *   YUYV               packed (CV_8UC2)
+ *   RGB888, BGR888     packed (CV_8UC3)
+ *   XRGB8888           packed (CV_8UC4)
+ *
+ * Buffers carrying all planes in a single FrameBuffer plane are split
+ * according to the stride, as libcamera lays them out contiguously.
+ */
+class ImageView
+{
+public:
+	ImageView() = default;
+	ImageView(const std::vector<libcamera::Span<uint8_t>> &planes,
+		  const libcamera::PixelFormat &format,
+		  const libcamera::Size &size, unsigned int stride);
+
+	static bool isSupported(const libcamera::PixelFormat &format);
+	static unsigned int minimumStride(const libcamera::PixelFormat &format,
+					  unsigned int width);
+	static std::vector<size_t> planeSizes(const libcamera::PixelFormat &format,
+					      const libcamera::Size &size,
+					      unsigned int stride);
+
+	bool isValid() const { return !planes_.empty(); }
+	const libcamera::PixelFormat &format() const { return format_; }
+	unsigned int numPlanes() const { return planes_.size(); }
+	const cv::Mat &plane(unsigned int index) const { return planes_[index]; }
+	const std::vector<cv::Mat> &planes() const { return planes_; }
+
+	/*
+	 * Conversions store the result in \a dst. When the frame already has the
+	 * requested layout \a dst becomes another view of the mapped memory and
+	 * nothing is allocated or copied. Otherwise memory comes from the
+	 * allocator of \a dst, if it has one.
+	 */
+	bool toBGR(cv::Mat &dst) const;
+	bool toGray(cv::Mat &dst) const;
+
+private:
+	libcamera::PixelFormat format_;
+	std::vector<cv::Mat> planes_;
+};
+
+#endif /* __SIMPLE_CAM_IMAGE_VIEW_H__ */
@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * image_writer.cpp - Asynchronous image encoding and writing
+ */
+
+#include "image_writer.h"
+
+#include <iostream>
+
+ImageWriter::ImageWriter(unsigned int workers, size_t capacity, Overflow overflow)
+	: capacity_(capacity ? capacity : 1), overflow_(overflow),
+	  budget_(nullptr), busy_(0),
+	  stopping_(false), queued_(0), written_(0), dropped_(0), failed_(0)
+{
+	if (!workers)
+		workers = 1;
+
+	for (unsigned int i = 0; i < workers; ++i)
+		workers_.emplace_back(&ImageWriter::run, this);
+}
+
+ImageWriter::~ImageWriter()
+{
+	stop();
+}
+
+/*
+ * Queue \a image to be written to \a filename. Returns Evicted if queued
+ * images were dropped to make room, OverBudget if it doesn't fit the budget,
+ * and Rejected if it wasn't queued for any other reason: because the writer
+ * is stopped, or because the queue is full and the policy is DropNewest.
+ *
+ * Only the drops caused by this call are reported, not those of concurrent
+ * writers or of stop().
+ */
+ImageWriter::Result ImageWriter::write(const std::string &filename, cv::Mat image)
+{
+	size_t bytes = image.total() * image.elemSize();
+	Result result = Result::Queued;
+
+	std::unique_lock<std::mutex> locker(lock_);
+
+	if (jobs_.size() >= capacity_ && !stopping_) {
+		switch (overflow_) {
+		case Overflow::Block:
+			spaceAvailable_.wait(locker, [&] {
+				return jobs_.size() < capacity_ || stopping_;
+			});
+			break;
+		case Overflow::DropOldest:
+			discard(jobs_.front().bytes);
+			jobs_.pop_front();
+			result = Result::Evicted;
+			break;
+		case Overflow::DropNewest:
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return Result::Rejected;
+		}
+	}
+
+	if (stopping_) {
+		dropped_.fetch_add(1, std::memory_order_relaxed);
+		return Result::Rejected;
+	}
+
+	/*
+	 * Charge the budget once there is room in the queue. With DropOldest,
+	 * the memory of older images is given up for the new one too.
+	 */
+	while (budget_ && !budget_->tryCharge(MemoryBudget::Category::WriterQueue, bytes)) {
+		if (overflow_ != Overflow::DropOldest || jobs_.empty()) {
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return Result::OverBudget;
+		}
+
+		discard(jobs_.front().bytes);
+		jobs_.pop_front();
+		result = Result::Evicted;
+	}
+
+	jobs_.push_back({ filename, std::move(image), bytes });
+	queued_.fetch_add(1, std::memory_order_relaxed);
+	locker.unlock();
+
+	jobAvailable_.notify_one();
+	return result;
+}
+
+/* Wait until every queued image has been written. */
+void ImageWriter::flush()
+{
+	std::unique_lock<std::mutex> locker(lock_);
+	idle_.wait(locker, [&] { return jobs_.empty() && !busy_; });
+}
+
+/* Wait up to \a timeout for every queued image to be written. */
+bool ImageWriter::flush(std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> locker(lock_);
+	return idle_.wait_for(locker, timeout, [&] { return jobs_.empty() && !busy_; });
+}
+
+/*
+ * Stop the workers, after writing out the queue if \a drain is set or
+ * dropping it otherwise. Images being written are always finished. Later
+ * writes are dropped.
+ */
+void ImageWriter::stop(bool drain)
+{
+	{
+		std::unique_lock<std::mutex> locker(lock_);
+		if (stopping_ && workers_.empty())
+			return;
+		stopping_ = true;
+
+		if (!drain) {
+			for (const Job &job : jobs_)
+				discard(job.bytes);
+			jobs_.clear();
+		}
+	}
+
+	jobAvailable_.notify_all();
+	spaceAvailable_.notify_all();
+
+	for (std::thread &worker : workers_)
+		worker.join();
+	workers_.clear();
+}
+
+/* Account for a queued image dropped instead of written. */
+void ImageWriter::discard(size_t bytes)
+{
+	dropped_.fetch_add(1, std::memory_order_relaxed);
+	if (budget_)
+		budget_->release(MemoryBudget::Category::WriterQueue, bytes);
+}
+
+size_t ImageWriter::pending() const
+{
+	std::unique_lock<std::mutex> locker(lock_);
+	return jobs_.size() + busy_;
+}
+
+ImageWriter::Stats ImageWriter::stats() const
+{
+	return {
+		queued_.load(std::memory_order_relaxed),
+		written_.load(std::memory_order_relaxed),
+		dropped_.load(std::memory_order_relaxed),
+		failed_.load(std::memory_order_relaxed),
+	};
+}
+
+void ImageWriter::run()
+{
+	std::unique_lock<std::mutex> locker(lock_);
+
+	while (true) {
+		jobAvailable_.wait(locker, [&] {
+			return !jobs_.empty() || stopping_;
+		});
+
+		if (jobs_.empty())
+			break;
+
+		Job job = std::move(jobs_.front());
+		jobs_.pop_front();
+		busy_++;
+		locker.unlock();
+
+		spaceAvailable_.notify_one();
+
+		bool ok = false;
+		try {
+			ok = cv::imwrite(job.filename, job.image);
+		} catch (const cv::Exception &e) {
+			std::cerr << "Can't write " << job.filename << ": "
+				  << e.what() << std::endl;
+		}
+
+		if (ok)
+			written_.fetch_add(1, std::memory_order_relaxed);
+		else
+			failed_.fetch_add(1, std::memory_order_relaxed);
+
+		/* Release the pixels before going back to sleep. */
+		job.image.release();
+		if (budget_)
+			budget_->release(MemoryBudget::Category::WriterQueue, job.bytes);
+
+		locker.lock();
+		busy_--;
+		if (jobs_.empty() && !busy_)
+			idle_.notify_all();
+	}
+}
@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * image_writer.h - Asynchronous image encoding and writing
+ */
+#ifndef __SIMPLE_CAM_IMAGE_WRITER_H__
+#define __SIMPLE_CAM_IMAGE_WRITER_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "memory_budget.h"
+
+/*
+ * Encodes and writes images on a pool of worker threads, fed by a bounded
+ * queue. When the queue is full the overflow policy decides whether write()
+ * waits for room, evicts the oldest queued image or rejects the new one.
+ *
+ * Queued images are written as they are, so they must own their pixels (or
+ * otherwise outlive the write): pass a clone of views into camera buffers.
+ *
+ * With a MemoryBudget, queued images are charged to it until written, and
+ * those it refuses are dropped, unless the policy is DropOldest and evicting
+ * older images makes room for them.
+ */
+class ImageWriter
+{
+public:
+	enum class Overflow {
+		Block,
+		DropOldest,
+		DropNewest,
+	};
+
+	/* What write() did with the image, and with the queue to make room. */
+	enum class Result {
+		Queued,
+		Evicted,
+		Rejected,
+		OverBudget,
+	};
+
+	struct Stats {
+		uint64_t queued;
+		uint64_t written;
+		uint64_t dropped;
+		uint64_t failed;
+	};
+
+	ImageWriter(unsigned int workers = 2, size_t capacity = 8,
+		    Overflow overflow = Overflow::DropOldest);
+	~ImageWriter();
+
+	void setBudget(MemoryBudget *budget) { budget_ = budget; }
+
+	Result write(const std::string &filename, cv::Mat image);
+	void flush();
+	bool flush(std::chrono::milliseconds timeout);
+	void stop(bool drain = true);
+
+	size_t pending() const;
+	Stats stats() const;
+
+private:
+	struct Job {
+		std::string filename;
+		cv::Mat image;
+		size_t bytes;
+	};
+
+	void run();
+	void discard(size_t bytes);
+
+	const size_t capacity_;
+	const Overflow overflow_;
+	MemoryBudget *budget_;
+
+	mutable std::mutex lock_;
+	std::condition_variable jobAvailable_;
+	std::condition_variable spaceAvailable_;
+	std::condition_variable idle_;
+	std::deque<Job> jobs_;
+	unsigned int busy_;
+	bool stopping_;
+
+	std::vector<std::thread> workers_;
+
+	std::atomic<uint64_t> queued_;
+	std::atomic<uint64_t> written_;
+	std::atomic<uint64_t> dropped_;
+	std::atomic<uint64_t> failed_;
+};
+
+#endif /* __SIMPLE_CAM_IMAGE_WRITER_H__ */
@@ -1,9 +1,65 @@
+#include <ctype.h>
+#include <errno.h>
+#include <iostream>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "SimpleCam.h"
 
 int main(int argc, char **argv)
 {
     SimpleCam cam;
-    cam.start();
+    cam.setFrameCallback([&cam](const Frame &frame) {
+        cam.saveImage(frame, "images/img" + std::to_string((double)clock() / CLOCKS_PER_SEC) + ".png");
+    });
+
+    for (int i = 1; i < argc; ++i)
+    {
+        /* --synthetic runs without a sensor, from generated YUV420 frames. */
+        if (!strcmp(argv[i], "--synthetic"))
+            cam.synthetic = std::make_unique<SyntheticCamera>(formats::YUV420, cam.size);
+        /* --udmabuf captures into buffers allocated here, through /dev/udmabuf. */
+        else if (!strcmp(argv[i], "--udmabuf"))
+            cam.pool = std::make_unique<BufferPool>(BufferPool::Backing::Udmabuf);
+        /* --publish PATH shares frames with FrameSubscribers connecting to PATH. */
+        else if (!strcmp(argv[i], "--publish") && i + 1 < argc)
+            cam.publisher = std::make_unique<FramePublisher>(argv[++i]);
+        /* --memory-limit MB sheds images past MB megabytes of pinned memory. */
+        else if (!strcmp(argv[i], "--memory-limit") && i + 1 < argc)
+        {
+            /* A typo must not turn into 0, which means no limit at all. */
+            const char *limit = argv[++i];
+            char *end;
+            errno = 0;
+            unsigned long megabytes = strtoul(limit, &end, 10);
+            if (!isdigit(static_cast<unsigned char>(*limit)) || *end || errno || megabytes > (SIZE_MAX >> 20))
+            {
+                std::cerr << "Invalid memory limit: " << limit << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            cam.budget.setLimit(static_cast<size_t>(megabytes) << 20);
+        }
+    }
+
+    /*
+     * Block the stop signals before any thread is started so they all
+     * inherit the mask, and take them synchronously here instead.
+     */
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+
+    if (cam.start())
+        return EXIT_FAILURE;
     cam.go();
-    cam.finish();
-}
\ No newline at end of file
+
+    int signal;
+    sigwait(&stopSignals, &signal);
+
+    return cam.finish();
+}
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * mapped_buffer_cache.cpp - Persistent CPU mappings of FrameBuffers
+ */
+
+#include "mapped_buffer_cache.h"
+
+#include <iostream>
+#include <string.h>
+
+using namespace libcamera;
+
+MappedBufferCache::MappedBufferCache()
+	: budget_(nullptr)
+{
+}
+
+MappedBufferCache::~MappedBufferCache()
+{
+	clear();
+}
+
+int MappedBufferCache::map(const FrameBuffer *buffer, MapFlags flags)
+{
+	if (maps_.count(buffer))
+		return 0;
+
+	MappedFrameBuffer mapped(buffer, flags);
+	if (!mapped.isValid()) {
+		std::cerr << "Failed to map buffer " << (const void *)buffer
+			  << ": " << strerror(-mapped.error()) << std::endl;
+		return mapped.error();
+	}
+
+	if (budget_)
+		budget_->charge(MemoryBudget::Category::Mappings, mapped.mappedSize());
+
+	maps_.emplace(buffer, std::move(mapped));
+	return 0;
+}
+
+int MappedBufferCache::map(const std::vector<std::unique_ptr<FrameBuffer>> &buffers,
+			   MapFlags flags)
+{
+	for (const std::unique_ptr<FrameBuffer> &buffer : buffers) {
+		int ret = map(buffer.get(), flags);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+void MappedBufferCache::unmap(const FrameBuffer *buffer)
+{
+	auto it = maps_.find(buffer);
+	if (it == maps_.end())
+		return;
+
+	if (budget_)
+		budget_->release(MemoryBudget::Category::Mappings, it->second.mappedSize());
+	maps_.erase(it);
+}
+
+void MappedBufferCache::clear()
+{
+	if (budget_) {
+		for (const auto &[buffer, mapped] : maps_)
+			budget_->release(MemoryBudget::Category::Mappings, mapped.mappedSize());
+	}
+
+	maps_.clear();
+}
+
+/*
+ * Forget every mapping without unmapping it, for buffers that may still be
+ * read after the cache is gone. The memory stays mapped, and charged to the
+ * budget, until the process exits.
+ */
+void MappedBufferCache::abandon()
+{
+	/* Moving the map keeps its nodes, and the pointers find() returned. */
+	new std::unordered_map<const FrameBuffer *, MappedFrameBuffer>(std::move(maps_));
+	maps_.clear();
+}
+
+const MappedFrameBuffer *MappedBufferCache::find(const FrameBuffer *buffer) const
+{
+	auto it = maps_.find(buffer);
+	if (it == maps_.end())
+		return nullptr;
+
+	return &it->second;
+}
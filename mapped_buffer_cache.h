@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * mapped_buffer_cache.h - Persistent CPU mappings of FrameBuffers
+ */
+#ifndef __SIMPLE_CAM_MAPPED_BUFFER_CACHE_H__
+#define __SIMPLE_CAM_MAPPED_BUFFER_CACHE_H__
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <libcamera/framebuffer.h>
+
+#include "mapped_framebuffer.h"
+#include "memory_budget.h"
+
+/*
+ * Maps each FrameBuffer once, when it is allocated, and keeps the mapping
+ * until clear(). Buffers are looked up by pointer on every completed frame.
+ *
+ * map() and clear() must not run concurrently with find(): populate the
+ * cache before the camera starts and tear it down after it has stopped.
+ */
+class MappedBufferCache
+{
+public:
+	using MapFlags = libcamera::MappedFrameBuffer::MapFlags;
+
+	MappedBufferCache();
+	~MappedBufferCache();
+
+	void setBudget(MemoryBudget *budget) { budget_ = budget; }
+
+	int map(const libcamera::FrameBuffer *buffer, MapFlags flags);
+	int map(const std::vector<std::unique_ptr<libcamera::FrameBuffer>> &buffers,
+		MapFlags flags);
+	void unmap(const libcamera::FrameBuffer *buffer);
+	void clear();
+	void abandon();
+
+	const libcamera::MappedFrameBuffer *find(const libcamera::FrameBuffer *buffer) const;
+	size_t size() const { return maps_.size(); }
+
+private:
+	std::unordered_map<const libcamera::FrameBuffer *,
+			   libcamera::MappedFrameBuffer> maps_;
+	MemoryBudget *budget_;
+};
+
+#endif /* __SIMPLE_CAM_MAPPED_BUFFER_CACHE_H__ */
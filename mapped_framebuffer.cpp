@@ -9,7 +9,9 @@
 
 #include <algorithm>
 #include <errno.h>
+#include <linux/dma-buf.h>
 #include <map>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -124,6 +126,22 @@ MappedBuffer::~MappedBuffer()
  * \return A vector of the mapped planes
  */
 
+/**
+ * \brief Retrieve the total size of the memory mappings
+ *
+ * Planes sharing a mapping are only counted once.
+ *
+ * \return The number of bytes mapped
+ */
+size_t MappedBuffer::mappedSize() const
+{
+	size_t size = 0;
+	for (const Plane &map : maps_)
+		size += map.size();
+
+	return size;
+}
+
 /**
  * \var MappedBuffer::error_
  * \brief Stores the error value if present
@@ -170,6 +188,80 @@ MappedBuffer::~MappedBuffer()
  * \brief A bitwise combination of MappedFrameBuffer::MapFlag values
  */
 
+/**
+ * \class MappedFrameBuffer::CpuAccess
+ * \brief Scoped CPU access to the memory of a MappedFrameBuffer
+ *
+ * A CpuAccess brackets CPU reads and writes of a mapping with the
+ * DMA_BUF_SYNC_START and DMA_BUF_SYNC_END synchronisation of all the dmabufs
+ * behind it, which lets the exporter flush or invalidate the CPU caches as
+ * needed. This is what makes cached mappings of dmabufs written by a device
+ * safe to read. Access ends when the CpuAccess is destroyed or end() is
+ * called.
+ *
+ * Nothing is done for buffers not backed by a dmabuf supporting the sync
+ * ioctl, such as memfd buffers.
+ */
+
+/**
+ * \brief Construct a CpuAccess not covering any buffer
+ */
+MappedFrameBuffer::CpuAccess::CpuAccess()
+	: buffer_(nullptr), flags_(0)
+{
+}
+
+MappedFrameBuffer::CpuAccess::CpuAccess(const MappedFrameBuffer *buffer,
+					 uint64_t flags)
+	: buffer_(buffer), flags_(flags)
+{
+}
+
+MappedFrameBuffer::CpuAccess::~CpuAccess()
+{
+	end();
+}
+
+/**
+ * \brief Move constructor, take over the CPU access of \a other
+ * \param[in] other The other CpuAccess
+ */
+MappedFrameBuffer::CpuAccess::CpuAccess(CpuAccess &&other)
+	: buffer_(other.buffer_), flags_(other.flags_)
+{
+	other.buffer_ = nullptr;
+}
+
+/**
+ * \brief Move assignment operator, end the current CPU access and take over
+ * the one of \a other
+ * \param[in] other The other CpuAccess
+ */
+MappedFrameBuffer::CpuAccess &
+MappedFrameBuffer::CpuAccess::operator=(CpuAccess &&other)
+{
+	if (this != &other) {
+		end();
+		buffer_ = other.buffer_;
+		flags_ = other.flags_;
+		other.buffer_ = nullptr;
+	}
+
+	return *this;
+}
+
+/**
+ * \brief End CPU access to the buffer, if not done already
+ */
+void MappedFrameBuffer::CpuAccess::end()
+{
+	if (!buffer_)
+		return;
+
+	buffer_->sync(DMA_BUF_SYNC_END | flags_);
+	buffer_ = nullptr;
+}
+
 /**
  * \brief Map all planes of a FrameBuffer
  * \param[in] buffer FrameBuffer to be mapped
@@ -240,6 +332,66 @@ MappedFrameBuffer::MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags)
 
 		planes_.emplace_back(info.address + plane.offset, plane.length);
 	}
+
+	/*
+	 * Probe each dmabuf with an empty access once, so that buffers which
+	 * don't support the sync ioctl cost nothing afterwards.
+	 */
+	for (const auto &[fd, info] : mappedBuffers) {
+		struct dma_buf_sync sync = { DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ };
+		if (ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync) < 0)
+			continue;
+
+		sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ;
+		ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+		syncFds_.push_back(fd);
+	}
+}
+
+/**
+ * \brief Start CPU access to the buffer
+ * \param[in] access The kind of access, reads, writes or both
+ *
+ * The buffer must stay mapped until the returned CpuAccess has ended.
+ *
+ * \return A CpuAccess ending the access when destroyed
+ */
+MappedFrameBuffer::CpuAccess MappedFrameBuffer::beginCpuAccess(MapFlags access) const
+{
+	if (syncFds_.empty())
+		return CpuAccess();
+
+	uint64_t flags = 0;
+	if (access & MapFlag::Read)
+		flags |= DMA_BUF_SYNC_READ;
+	if (access & MapFlag::Write)
+		flags |= DMA_BUF_SYNC_WRITE;
+
+	sync(DMA_BUF_SYNC_START | flags);
+
+	return CpuAccess(this, flags);
+}
+
+int MappedFrameBuffer::sync(uint64_t flags) const
+{
+	int ret = 0;
+
+	for (int fd : syncFds_) {
+		struct dma_buf_sync sync = { flags };
+
+		/* The ioctl is restarted if interrupted by a signal. */
+		while (ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync) < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+
+			ret = -errno;
+			LOG(Buffer, Error) << "Failed to sync dmabuf: "
+					   << strerror(-ret);
+			break;
+		}
+	}
+
+	return ret;
 }
 
 } /* namespace libcamera */
\ No newline at end of file
@@ -31,6 +31,7 @@ public:
 	bool isValid() const { return error_ == 0; }
 	int error() const { return error_; }
 	const std::vector<Plane> &planes() const { return planes_; }
+	size_t mappedSize() const;
 
 protected:
 	MappedBuffer();
@@ -54,7 +55,36 @@ public:
 
 	using MapFlags = Flags<MapFlag>;
 
+	class CpuAccess
+	{
+	public:
+		CpuAccess();
+		~CpuAccess();
+
+		CpuAccess(CpuAccess &&other);
+		CpuAccess &operator=(CpuAccess &&other);
+
+		void end();
+
+	private:
+		LIBCAMERA_DISABLE_COPY(CpuAccess)
+
+		friend class MappedFrameBuffer;
+
+		CpuAccess(const MappedFrameBuffer *buffer, uint64_t flags);
+
+		const MappedFrameBuffer *buffer_;
+		uint64_t flags_;
+	};
+
 	MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags);
+
+	CpuAccess beginCpuAccess(MapFlags access) const;
+
+private:
+	int sync(uint64_t flags) const;
+
+	std::vector<int> syncFds_;
 };
 
 LIBCAMERA_FLAGS_ENABLE_OPERATORS(MappedFrameBuffer::MapFlag)
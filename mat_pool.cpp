@@ -0,0 +1,168 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * mat_pool.cpp - Recycling cv::MatAllocator for full frame images
+ */
+
+#include "mat_pool.h"
+
+#include <sstream>
+#include <stdlib.h>
+
+MatPool::MatPool(size_t maxCached, size_t alignment)
+	: maxCached_(maxCached), alignment_(alignment), budget_(nullptr),
+	  inUse_(0), cached_(0),
+	  hits_(0), misses_(0)
+{
+}
+
+MatPool::~MatPool()
+{
+	trim();
+}
+
+size_t MatPool::blockSize(size_t size) const
+{
+	return (size + 4095) & ~static_cast<size_t>(4095);
+}
+
+/* Modelled on OpenCV's own StdMatAllocator. */
+cv::UMatData *MatPool::allocate(int dims, const int *sizes, int type, void *data,
+				size_t *step, cv::AccessFlag flags,
+				cv::UMatUsageFlags usageFlags) const
+{
+	size_t total = CV_ELEM_SIZE(type);
+	for (int i = dims - 1; i >= 0; i--) {
+		if (step) {
+			if (data && step[i] != cv::Mat::AUTO_STEP)
+				total = step[i];
+			else
+				step[i] = total;
+		}
+		total *= sizes[i];
+	}
+
+	cv::UMatData *u = new cv::UMatData(this);
+	u->size = total;
+
+	if (data) {
+		u->data = u->origdata = static_cast<uchar *>(data);
+		u->flags |= cv::UMatData::USER_ALLOCATED;
+		return u;
+	}
+
+	if (total < kMinPooled) {
+		u->data = u->origdata = static_cast<uchar *>(cv::fastMalloc(total));
+		return u;
+	}
+
+	size_t size = blockSize(total);
+	void *block = nullptr;
+
+	{
+		std::unique_lock<std::mutex> locker(lock_);
+
+		auto it = free_.find(size);
+		if (it != free_.end() && !it->second.empty()) {
+			block = it->second.back();
+			it->second.pop_back();
+			cached_ -= size;
+		}
+
+		inUse_ += size;
+	}
+
+	if (block) {
+		hits_.fetch_add(1, std::memory_order_relaxed);
+		if (budget_)
+			budget_->release(MemoryBudget::Category::MatPool, size);
+	} else {
+		misses_.fetch_add(1, std::memory_order_relaxed);
+		if (posix_memalign(&block, alignment_, size)) {
+			std::unique_lock<std::mutex> locker(lock_);
+			inUse_ -= size;
+			delete u;
+			CV_Error(cv::Error::StsNoMem, "Failed to allocate pooled Mat");
+		}
+	}
+
+	u->data = u->origdata = static_cast<uchar *>(block);
+	return u;
+}
+
+bool MatPool::allocate(cv::UMatData *data, cv::AccessFlag accessFlags,
+		       cv::UMatUsageFlags usageFlags) const
+{
+	return data != nullptr;
+}
+
+void MatPool::deallocate(cv::UMatData *u) const
+{
+	if (!u)
+		return;
+
+	CV_Assert(u->urefcount == 0);
+	CV_Assert(u->refcount == 0);
+
+	if (u->flags & cv::UMatData::USER_ALLOCATED) {
+		delete u;
+		return;
+	}
+
+	if (u->size < kMinPooled) {
+		cv::fastFree(u->origdata);
+		delete u;
+		return;
+	}
+
+	size_t size = blockSize(u->size);
+	void *block = u->origdata;
+	delete u;
+
+	{
+		std::unique_lock<std::mutex> locker(lock_);
+
+		inUse_ -= size;
+		if (cached_ + size <= maxCached_ &&
+		    (!budget_ || budget_->tryCharge(MemoryBudget::Category::MatPool, size))) {
+			free_[size].push_back(block);
+			cached_ += size;
+			block = nullptr;
+		}
+	}
+
+	::free(block);
+}
+
+/* Free all the blocks kept for reuse. */
+void MatPool::trim()
+{
+	std::unordered_map<size_t, std::vector<void *>> blocks;
+	{
+		std::unique_lock<std::mutex> locker(lock_);
+		blocks.swap(free_);
+		if (budget_)
+			budget_->release(MemoryBudget::Category::MatPool, cached_);
+		cached_ = 0;
+	}
+
+	for (auto &[size, list] : blocks) {
+		for (void *block : list)
+			::free(block);
+	}
+}
+
+MatPool::Stats MatPool::stats() const
+{
+	std::unique_lock<std::mutex> locker(lock_);
+
+	return { hits_.load(std::memory_order_relaxed),
+		 misses_.load(std::memory_order_relaxed), inUse_, cached_ };
+}
+
+std::string MatPool::Stats::toString() const
+{
+	std::ostringstream ss;
+	ss << hits << " hits, " << misses << " misses, " << inUse
+	   << " bytes in use, " << cached << " bytes cached";
+	return ss.str();
+}
@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * mat_pool.h - Recycling cv::MatAllocator for full frame images
+ */
+#ifndef __SIMPLE_CAM_MAT_POOL_H__
+#define __SIMPLE_CAM_MAT_POOL_H__
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "memory_budget.h"
+
+/*
+ * Keeps the blocks of large Mats when they are released, and hands them
+ * out again to the next Mat of the same size, so that converting a frame
+ * per frame doesn't go through malloc() and page faults every time. Blocks
+ * are aligned to \a alignment and looked up by their size rounded up to a
+ * page. Mats smaller than kMinPooled are allocated as usual.
+ *
+ * Install it on a Mat before anything allocates it, with
+ * `mat.allocator = &pool`: the Mats written by cv::cvtColor() and friends
+ * then come from the pool, and so do ImageView conversion temporaries. The
+ * pool must outlive every Mat it allocated.
+ *
+ * Up to \a maxCached bytes of free blocks are kept, the blocks released
+ * past that are freed. So are those the MemoryBudget, if any, refuses.
+ */
+class MatPool : public cv::MatAllocator
+{
+public:
+	static constexpr size_t kMinPooled = 64 * 1024;
+
+	struct Stats {
+		uint64_t hits;
+		uint64_t misses;
+		size_t inUse;
+		size_t cached;
+
+		std::string toString() const;
+	};
+
+	explicit MatPool(size_t maxCached = 64 * 1024 * 1024, size_t alignment = 64);
+	~MatPool();
+
+	cv::UMatData *allocate(int dims, const int *sizes, int type, void *data,
+			       size_t *step, cv::AccessFlag flags,
+			       cv::UMatUsageFlags usageFlags) const override;
+	bool allocate(cv::UMatData *data, cv::AccessFlag accessFlags,
+		      cv::UMatUsageFlags usageFlags) const override;
+	void deallocate(cv::UMatData *data) const override;
+
+	void setBudget(MemoryBudget *budget) { budget_ = budget; }
+
+	void trim();
+	Stats stats() const;
+
+private:
+	size_t blockSize(size_t size) const;
+
+	const size_t maxCached_;
+	const size_t alignment_;
+	MemoryBudget *budget_;
+
+	mutable std::mutex lock_;
+	mutable std::unordered_map<size_t, std::vector<void *>> free_;
+	mutable size_t inUse_;
+	mutable size_t cached_;
+
+	mutable std::atomic<uint64_t> hits_;
+	mutable std::atomic<uint64_t> misses_;
+};
+
+#endif /* __SIMPLE_CAM_MAT_POOL_H__ */
@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * memory_budget.cpp - Accounting of the memory pinned by the capture path
+ */
+
+#include "memory_budget.h"
+
+#include <sstream>
+
+/* A limit of 0 means no limit. */
+MemoryBudget::MemoryBudget(size_t limit)
+	: limit_(limit), total_(0), peak_(0), refused_(0)
+{
+	for (unsigned int i = 0; i < kNumCategories; ++i) {
+		current_[i].store(0, std::memory_order_relaxed);
+		peaks_[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+void MemoryBudget::raise(std::atomic<size_t> &peak, size_t value)
+{
+	size_t previous = peak.load(std::memory_order_relaxed);
+	while (previous < value &&
+	       !peak.compare_exchange_weak(previous, value, std::memory_order_relaxed))
+		;
+}
+
+/* Charge \a bytes to \a category, even past the limit. */
+void MemoryBudget::charge(Category category, size_t bytes)
+{
+	unsigned int index = static_cast<unsigned int>(category);
+
+	raise(peak_, total_.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+	raise(peaks_[index], current_[index].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+}
+
+/* Charge \a bytes to \a category if that keeps the total within the limit. */
+bool MemoryBudget::tryCharge(Category category, size_t bytes)
+{
+	unsigned int index = static_cast<unsigned int>(category);
+	size_t limit = limit_.load(std::memory_order_relaxed);
+	size_t total = total_.load(std::memory_order_relaxed);
+
+	do {
+		if (limit && total + bytes > limit) {
+			refused_.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	} while (!total_.compare_exchange_weak(total, total + bytes,
+					       std::memory_order_relaxed));
+
+	raise(peak_, total + bytes);
+	raise(peaks_[index], current_[index].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+
+	return true;
+}
+
+void MemoryBudget::release(Category category, size_t bytes)
+{
+	unsigned int index = static_cast<unsigned int>(category);
+
+	current_[index].fetch_sub(bytes, std::memory_order_relaxed);
+	total_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+/* Tell whether \a bytes more would currently stay within the limit. */
+bool MemoryBudget::fits(size_t bytes) const
+{
+	size_t limit = limit_.load(std::memory_order_relaxed);
+	return !limit || current() + bytes <= limit;
+}
+
+size_t MemoryBudget::current(Category category) const
+{
+	return current_[static_cast<unsigned int>(category)].load(std::memory_order_relaxed);
+}
+
+size_t MemoryBudget::peak(Category category) const
+{
+	return peaks_[static_cast<unsigned int>(category)].load(std::memory_order_relaxed);
+}
+
+std::string MemoryBudget::toString() const
+{
+	static const char *names[kNumCategories] = {
+		"mappings", "mat pool", "writer queue", "rings",
+	};
+
+	std::ostringstream ss;
+	ss << "current " << current() << " peak " << peak();
+	if (limit())
+		ss << " limit " << limit() << " refused " << refused();
+
+	for (unsigned int i = 0; i < kNumCategories; ++i)
+		ss << (i ? ", " : " (") << names[i] << " "
+		   << current_[i].load(std::memory_order_relaxed) << "/"
+		   << peaks_[i].load(std::memory_order_relaxed);
+	ss << ")";
+
+	return ss.str();
+}
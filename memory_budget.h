@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * memory_budget.h - Accounting of the memory pinned by the capture path
+ */
+#ifndef __SIMPLE_CAM_MEMORY_BUDGET_H__
+#define __SIMPLE_CAM_MEMORY_BUDGET_H__
+
+#include <array>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/*
+ * Counts the bytes held by each part of the capture path, and the peaks
+ * they reached, against an optional global limit:
+ *
+ *   Mappings      CPU mappings of the capture buffers
+ *   MatPool       free blocks kept by a MatPool for reuse
+ *   WriterQueue   images waiting in an ImageWriter
+ *   Rings         control blocks shared with other processes
+ *
+ * Memory that can't be done without, such as the mappings, is charged
+ * unconditionally with charge(). Producers of optional memory ask with
+ * tryCharge() instead, and shed load (drop the image, free the block)
+ * when refused, so that the total stays under the limit.
+ *
+ * All methods are thread safe and lock free.
+ */
+class MemoryBudget
+{
+public:
+	enum class Category {
+		Mappings,
+		MatPool,
+		WriterQueue,
+		Rings,
+	};
+
+	static constexpr unsigned int kNumCategories = 4;
+
+	explicit MemoryBudget(size_t limit = 0);
+
+	void setLimit(size_t limit) { limit_.store(limit, std::memory_order_relaxed); }
+	size_t limit() const { return limit_.load(std::memory_order_relaxed); }
+
+	void charge(Category category, size_t bytes);
+	bool tryCharge(Category category, size_t bytes);
+	void release(Category category, size_t bytes);
+
+	bool fits(size_t bytes) const;
+
+	size_t current() const { return total_.load(std::memory_order_relaxed); }
+	size_t current(Category category) const;
+	size_t peak() const { return peak_.load(std::memory_order_relaxed); }
+	size_t peak(Category category) const;
+	uint64_t refused() const { return refused_.load(std::memory_order_relaxed); }
+
+	std::string toString() const;
+
+private:
+	static void raise(std::atomic<size_t> &peak, size_t value);
+
+	std::atomic<size_t> limit_;
+	std::atomic<size_t> total_;
+	std::atomic<size_t> peak_;
+	std::atomic<uint64_t> refused_;
+	std::array<std::atomic<size_t>, kNumCategories> current_;
+	std::array<std::atomic<size_t>, kNumCategories> peaks_;
+};
+
+#endif /* __SIMPLE_CAM_MEMORY_BUDGET_H__ */
@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * mpsc_queue.h - Bounded lock-free multi-producer single-consumer queue
+ */
+#ifndef __SIMPLE_CAM_MPSC_QUEUE_H__
+#define __SIMPLE_CAM_MPSC_QUEUE_H__
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Dmitry Vyukov's bounded queue, with the dequeue side reduced to a single
+ * consumer. Each cell carries a sequence number telling producers whether it
+ * is free and the consumer whether it has been published, so both sides only
+ * touch shared state through one atomic per operation and no memory is
+ * allocated after construction.
+ *
+ * push() may be called from any thread and fails when the queue is full.
+ * pop() must only ever be called from one thread. A producer that has
+ * claimed a cell but not yet published it makes the queue look empty to the
+ * consumer until it is done: producers must signal the consumer after
+ * pushing rather than rely on it polling. drained() tells such a queue apart
+ * from one that is really empty.
+ */
+template<typename T>
+class MpscQueue
+{
+public:
+	explicit MpscQueue(size_t capacity = 1024)
+		: mask_(roundUp(capacity) - 1), cells_(new Cell[mask_ + 1]),
+		  enqueuePos_(0), dequeuePos_(0)
+	{
+		for (size_t i = 0; i <= mask_; ++i)
+			cells_[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	MpscQueue(const MpscQueue &) = delete;
+	MpscQueue &operator=(const MpscQueue &) = delete;
+
+	size_t capacity() const { return mask_ + 1; }
+
+	bool push(T &&item)
+	{
+		size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+		Cell *cell;
+
+		while (true) {
+			cell = &cells_[pos & mask_];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr_t diff = static_cast<intptr_t>(sequence) -
+					static_cast<intptr_t>(pos);
+
+			if (diff == 0) {
+				if (enqueuePos_.compare_exchange_weak(pos, pos + 1,
+								      std::memory_order_relaxed))
+					break;
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = enqueuePos_.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->item = std::move(item);
+		cell->sequence.store(pos + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	bool pop(T &item)
+	{
+		Cell *cell = &cells_[dequeuePos_ & mask_];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		if (sequence != dequeuePos_ + 1)
+			return false;
+
+		item = std::move(cell->item);
+		cell->sequence.store(dequeuePos_ + mask_ + 1, std::memory_order_release);
+		dequeuePos_++;
+
+		return true;
+	}
+
+	/*
+	 * True when no cell has been claimed past the consumer, published or
+	 * not. Must only be called from the consumer thread.
+	 */
+	bool drained() const
+	{
+		return enqueuePos_.load(std::memory_order_acquire) == dequeuePos_;
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T item;
+	};
+
+	static size_t roundUp(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity)
+			size <<= 1;
+		return size;
+	}
+
+	const size_t mask_;
+	std::unique_ptr<Cell[]> cells_;
+
+	alignas(64) std::atomic<size_t> enqueuePos_;
+	alignas(64) size_t dequeuePos_;
+};
+
+#endif /* __SIMPLE_CAM_MPSC_QUEUE_H__ */
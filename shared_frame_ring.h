@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * shared_frame_ring.h - Layout of frames shared between processes
+ */
+#ifndef __SIMPLE_CAM_SHARED_FRAME_RING_H__
+#define __SIMPLE_CAM_SHARED_FRAME_RING_H__
+
+#include <atomic>
+#include <stdint.h>
+
+/*
+ * A FramePublisher shares the capture buffers themselves with its
+ * subscribers, along with a control block describing them. The control
+ * block lives in a sealed memfd that only the publisher can write.
+ *
+ * Each slot, one per capture buffer, is guarded by a sequence lock: its
+ * count is odd while the buffer belongs to the camera and its header is
+ * being written, and even while the frame it holds can be read. A reader
+ * samples the count, reads the frame in place, and checks the count is
+ * unchanged afterwards: if not, the camera wrote over the frame meanwhile
+ * and what was read must be thrown away. Readers never hold up the
+ * publisher.
+ *
+ * `published` counts frames and doubles as a futex word to wait on.
+ */
+namespace SharedFrameRing {
+
+static constexpr uint32_t kMagic = 0x53434652; /* "SCFR" */
+static constexpr uint32_t kVersion = 1;
+static constexpr unsigned int kMaxSlots = 32;
+static constexpr unsigned int kMaxPlanes = 3;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+	      "shared atomics must be lock free to work across processes");
+
+struct Plane {
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct Slot {
+	std::atomic<uint32_t> seq;
+	uint32_t pad;
+	uint64_t sequence;
+	uint64_t timestamp;
+	Plane planes[kMaxPlanes];
+};
+
+struct Header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t fourcc;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint32_t slotCount;
+	uint32_t planeCount;
+
+	std::atomic<uint32_t> published;
+	std::atomic<uint32_t> latest;
+	std::atomic<uint32_t> closed;
+	uint32_t pad;
+
+	Slot slots[kMaxSlots];
+};
+
+/*
+ * The control block fd is sent first, followed by one fd per plane of each
+ * slot, in slot order.
+ */
+static constexpr unsigned int kMaxFds = 1 + kMaxSlots * kMaxPlanes;
+
+} /* namespace SharedFrameRing */
+
+#endif /* __SIMPLE_CAM_SHARED_FRAME_RING_H__ */
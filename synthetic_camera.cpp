@@ -0,0 +1,181 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * synthetic_camera.cpp - memfd backed frame source for running without a sensor
+ */
+
+#include "synthetic_camera.h"
+
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <iostream>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "image_view.h"
+
+using namespace libcamera;
+
+SyntheticCamera::SyntheticCamera(const PixelFormat &format, const Size &size,
+				 double fps, unsigned int bufferCount,
+				 Pattern pattern)
+	: fps_(fps > 0 ? fps : 30.0), pattern_(pattern),
+	  pool_(BufferPool::Backing::Memfd), running_(false),
+	  generated_(0), skipped_(0), noise_(0x9e3779b97f4a7c15ULL)
+{
+	config_.pixelFormat = format;
+	config_.size = size;
+	config_.stride = (ImageView::minimumStride(format, size.width) + 63) & ~63U;
+	config_.bufferCount = bufferCount;
+	config_.frameSize = 0;
+	for (size_t length : ImageView::planeSizes(format, size, config_.stride))
+		config_.frameSize += length;
+}
+
+SyntheticCamera::~SyntheticCamera()
+{
+	stop();
+	free();
+}
+
+int SyntheticCamera::allocate()
+{
+	int ret = pool_.allocate(config_);
+	if (ret < 0) {
+		std::cerr << "Can't create synthetic buffers" << std::endl;
+		return ret;
+	}
+
+	return mappings_.map(pool_.buffers(), MappedFrameBuffer::MapFlag::ReadWrite);
+}
+
+void SyntheticCamera::free()
+{
+	mappings_.clear();
+	pool_.free();
+}
+
+int SyntheticCamera::start(CompletionCallback callback)
+{
+	if (running_)
+		return -EBUSY;
+	if (pool_.buffers().empty())
+		return -ENOMEM;
+
+	callback_ = std::move(callback);
+	running_ = true;
+	thread_ = std::thread(&SyntheticCamera::run, this);
+
+	return 0;
+}
+
+/* Stop the frame clock. Queued buffers are given back without completing. */
+void SyntheticCamera::stop()
+{
+	{
+		std::unique_lock<std::mutex> locker(lock_);
+		if (!running_)
+			return;
+		running_ = false;
+	}
+
+	stopped_.notify_all();
+	thread_.join();
+
+	std::unique_lock<std::mutex> locker(lock_);
+	queue_.clear();
+}
+
+int SyntheticCamera::queueBuffer(FrameBuffer *buffer)
+{
+	std::unique_lock<std::mutex> locker(lock_);
+	queue_.push_back(buffer);
+	return 0;
+}
+
+unsigned int SyntheticCamera::queued() const
+{
+	std::unique_lock<std::mutex> locker(lock_);
+	return queue_.size();
+}
+
+void SyntheticCamera::run()
+{
+	using clock = std::chrono::steady_clock;
+
+	const auto interval = std::chrono::duration_cast<clock::duration>(
+		std::chrono::duration<double>(1.0 / fps_));
+	auto next = clock::now();
+	unsigned int sequence = 0;
+
+	std::unique_lock<std::mutex> locker(lock_);
+
+	while (true) {
+		next += interval;
+		if (stopped_.wait_until(locker, next, [&] { return !running_; }))
+			break;
+
+		if (queue_.empty()) {
+			skipped_.fetch_add(1, std::memory_order_relaxed);
+			sequence++;
+			continue;
+		}
+
+		FrameBuffer *buffer = queue_.front();
+		queue_.pop_front();
+		locker.unlock();
+
+		fill(buffer, sequence);
+
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+
+		FrameMetadata metadata{};
+		metadata.status = FrameMetadata::FrameSuccess;
+		metadata.sequence = sequence++;
+		metadata.timestamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+		generated_.fetch_add(1, std::memory_order_relaxed);
+		callback_(buffer, metadata);
+
+		locker.lock();
+	}
+}
+
+void SyntheticCamera::fill(FrameBuffer *buffer, unsigned int sequence)
+{
+	const MappedFrameBuffer *mapped = mappings_.find(buffer);
+	if (!mapped)
+		return;
+
+	MappedFrameBuffer::CpuAccess access =
+		mapped->beginCpuAccess(MappedFrameBuffer::MapFlag::Write);
+
+	ImageView view(mapped->planes(), config_.pixelFormat, config_.size,
+		       config_.stride);
+
+	for (unsigned int i = 0; i < view.numPlanes(); ++i) {
+		const cv::Mat &plane = view.plane(i);
+		size_t length = plane.cols * plane.elemSize();
+		bool chroma = i > 0;
+
+		for (int y = 0; y < plane.rows; ++y) {
+			uint8_t *line = plane.data + y * plane.step[0];
+
+			if (chroma) {
+				memset(line, 128, length);
+			} else if (pattern_ == Pattern::Gradient) {
+				memset(line, (y + sequence * 4) & 0xff, length);
+			} else {
+				for (size_t x = 0; x < length; x += sizeof(noise_)) {
+					noise_ ^= noise_ << 13;
+					noise_ ^= noise_ >> 7;
+					noise_ ^= noise_ << 17;
+					memcpy(line + x, &noise_,
+					       std::min(sizeof(noise_), length - x));
+				}
+			}
+		}
+	}
+}
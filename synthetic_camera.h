@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * synthetic_camera.h - memfd backed frame source for running without a sensor
+ */
+#ifndef __SIMPLE_CAM_SYNTHETIC_CAMERA_H__
+#define __SIMPLE_CAM_SYNTHETIC_CAMERA_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include <libcamera/framebuffer.h>
+#include <libcamera/stream.h>
+
+#include "buffer_pool.h"
+#include "mapped_buffer_cache.h"
+
+/*
+ * Stands in for a Camera on machines without one. Buffers come from a memfd
+ * BufferPool, with the stride padded to 64 bytes.
+ *
+ * Once started, a thread ticks at the configured frame rate. On each tick
+ * it fills the oldest queued buffer with a pattern and completes it, or,
+ * when no buffer is queued, drops the frame as a sensor would: the sequence
+ * number still advances.
+ *
+ * The completion callback runs on the synthetic camera thread, in place of
+ * the CameraManager thread.
+ */
+class SyntheticCamera
+{
+public:
+	enum class Pattern {
+		Gradient,
+		Noise,
+	};
+
+	using CompletionCallback = std::function<void(libcamera::FrameBuffer *buffer,
+						      const libcamera::FrameMetadata &metadata)>;
+
+	SyntheticCamera(const libcamera::PixelFormat &format,
+			const libcamera::Size &size, double fps = 30.0,
+			unsigned int bufferCount = 4,
+			Pattern pattern = Pattern::Gradient);
+	~SyntheticCamera();
+
+	int allocate();
+	void free();
+
+	const libcamera::StreamConfiguration &configuration() const { return config_; }
+	const std::vector<std::unique_ptr<libcamera::FrameBuffer>> &buffers() const { return pool_.buffers(); }
+
+	int start(CompletionCallback callback);
+	void stop();
+
+	int queueBuffer(libcamera::FrameBuffer *buffer);
+	unsigned int queued() const;
+	uint64_t generated() const { return generated_.load(std::memory_order_relaxed); }
+	uint64_t skipped() const { return skipped_.load(std::memory_order_relaxed); }
+
+private:
+	void run();
+	void fill(libcamera::FrameBuffer *buffer, unsigned int sequence);
+
+	libcamera::StreamConfiguration config_;
+	const double fps_;
+	const Pattern pattern_;
+
+	BufferPool pool_;
+	MappedBufferCache mappings_;
+
+	CompletionCallback callback_;
+	std::thread thread_;
+	bool running_;
+
+	mutable std::mutex lock_;
+	std::condition_variable stopped_;
+	std::deque<libcamera::FrameBuffer *> queue_;
+
+	std::atomic<uint64_t> generated_;
+	std::atomic<uint64_t> skipped_;
+	uint64_t noise_;
+};
+
+#endif /* __SIMPLE_CAM_SYNTHETIC_CAMERA_H__ */
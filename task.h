@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * task.h - Move-only callable with inline storage
+ */
+#ifndef __SIMPLE_CAM_TASK_H__
+#define __SIMPLE_CAM_TASK_H__
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+ * A move-only replacement for std::function<void()>. Callables up to
+ * kInlineSize bytes that can be moved without throwing, such as a lambda
+ * capturing a Request pointer and a few more pointers, are stored inside the
+ * Task itself and never allocate. Larger ones fall back to the heap.
+ */
+class Task
+{
+public:
+	static constexpr size_t kInlineSize = 6 * sizeof(void *);
+
+	Task() noexcept
+		: ops_(nullptr)
+	{
+	}
+
+	template<typename F,
+		 typename = std::enable_if_t<!std::is_same<std::decay_t<F>, Task>::value>>
+	Task(F &&func)
+		: ops_(nullptr)
+	{
+		using Callable = std::decay_t<F>;
+
+		if constexpr (fitsInline<Callable>()) {
+			new (storage_) Callable(std::forward<F>(func));
+			ops_ = &InlineOps<Callable>::ops;
+		} else {
+			new (storage_) Callable *(new Callable(std::forward<F>(func)));
+			ops_ = &HeapOps<Callable>::ops;
+		}
+	}
+
+	Task(Task &&other) noexcept
+		: ops_(nullptr)
+	{
+		*this = std::move(other);
+	}
+
+	Task &operator=(Task &&other) noexcept
+	{
+		if (this == &other)
+			return *this;
+
+		reset();
+		if (other.ops_) {
+			other.ops_->move(storage_, other.storage_);
+			ops_ = other.ops_;
+			other.ops_ = nullptr;
+		}
+
+		return *this;
+	}
+
+	Task &operator=(std::nullptr_t) noexcept
+	{
+		reset();
+		return *this;
+	}
+
+	Task(const Task &) = delete;
+	Task &operator=(const Task &) = delete;
+
+	~Task()
+	{
+		reset();
+	}
+
+	explicit operator bool() const { return ops_ != nullptr; }
+
+	void operator()()
+	{
+		ops_->invoke(storage_);
+	}
+
+	template<typename Callable>
+	static constexpr bool fitsInline()
+	{
+		return sizeof(Callable) <= kInlineSize &&
+		       alignof(std::max_align_t) % alignof(Callable) == 0 &&
+		       std::is_nothrow_move_constructible<Callable>::value;
+	}
+
+private:
+	struct Ops {
+		void (*invoke)(void *storage);
+		void (*move)(void *dst, void *src);
+		void (*destroy)(void *storage);
+	};
+
+	template<typename Callable>
+	struct InlineOps {
+		static void invoke(void *storage)
+		{
+			(*static_cast<Callable *>(storage))();
+		}
+
+		static void move(void *dst, void *src)
+		{
+			Callable *callable = static_cast<Callable *>(src);
+			new (dst) Callable(std::move(*callable));
+			callable->~Callable();
+		}
+
+		static void destroy(void *storage)
+		{
+			static_cast<Callable *>(storage)->~Callable();
+		}
+
+		static constexpr Ops ops = { &invoke, &move, &destroy };
+	};
+
+	template<typename Callable>
+	struct HeapOps {
+		static void invoke(void *storage)
+		{
+			(**static_cast<Callable **>(storage))();
+		}
+
+		static void move(void *dst, void *src)
+		{
+			new (dst) Callable *(*static_cast<Callable **>(src));
+		}
+
+		static void destroy(void *storage)
+		{
+			delete *static_cast<Callable **>(storage);
+		}
+
+		static constexpr Ops ops = { &invoke, &move, &destroy };
+	};
+
+	void reset() noexcept
+	{
+		if (ops_) {
+			ops_->destroy(storage_);
+			ops_ = nullptr;
+		}
+	}
+
+	alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+	const Ops *ops_;
+};
+
+#endif /* __SIMPLE_CAM_TASK_H__ */